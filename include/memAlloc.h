@@ -0,0 +1 @@
+../src/mem/memAlloc.h
\ No newline at end of file
@@ -0,0 +1 @@
+../src/mem/memLog.h
\ No newline at end of file
@@ -0,0 +1 @@
+../src/mem/memMgr.h
\ No newline at end of file
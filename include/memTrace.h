@@ -0,0 +1 @@
+../src/mem/memTrace.h
\ No newline at end of file
@@ -0,0 +1,13 @@
+benchAlign.o: benchAlign.cpp bench.h ../../include/memMgr.h \
+ ../../include/memTrace.h
+benchCore.o: benchCore.cpp bench.h ../../include/memMgr.h \
+ ../../include/memTrace.h
+benchPolicy.o: benchPolicy.cpp bench.h ../../include/memMgr.h \
+ ../../include/memTrace.h
+benchScope.o: benchScope.cpp bench.h ../../include/memMgr.h \
+ ../../include/memTrace.h
+benchShared.o: benchShared.cpp bench.h ../../include/memMgr.h \
+ ../../include/memTrace.h
+benchStl.o: benchStl.cpp bench.h ../../include/memAlloc.h \
+ ../../include/memMgr.h ../../include/memTrace.h
+memBench.o: memBench.cpp bench.h
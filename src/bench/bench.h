@@ -0,0 +1,55 @@
+/****************************************************************************
+  FileName     [ bench.h ]
+  PackageName  [ bench ]
+  Synopsis     [ Define the timer and the benchmarks of memBench ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Wall-clock timer; MyUsage ticks are too coarse for short runs
+class BenchTimer
+{
+public:
+   BenchTimer() { reset(); }
+
+   void reset() { _start = chrono::steady_clock::now(); }
+   // Nano-seconds since reset()
+   double ns() const {
+      return chrono::duration<double, nano>(
+                chrono::steady_clock::now() - _start).count();
+   }
+
+private:
+   chrono::steady_clock::time_point  _start;
+};
+
+// Keep 'v' from being optimized away
+extern volatile size_t benchSink;
+inline void benchKeep(size_t v) { benchSink = v; }
+
+// Results in a table, or as "bench,case,allocator,value,unit" rows if
+// benchCsv (memBench -Csv). The unit is ns/op but for the footprints.
+extern bool benchCsv;
+extern void benchTitle(const char* bench, size_t n, const string& what);
+extern void benchRow(const char* bench, const string& kase,
+                     const char* alloc, double value,
+                     const char* unit = "ns/op");
+
+// The benchmarks; 'n' is the #objects (0 for the default)
+extern void benchAlign(size_t n);
+extern void benchCore(size_t n);
+extern void benchPolicy(size_t n);
+extern void benchScope(size_t n);
+extern void benchShared(size_t n);
+extern void benchStl(size_t n);
+
+#endif // BENCH_H
@@ -0,0 +1,98 @@
+/****************************************************************************
+  FileName     [ benchAlign.cpp ]
+  PackageName  [ bench ]
+  Synopsis     [ Scan objects pooled with natural, no-straddle and
+                 cache-line alignments, and in fit mode ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include "bench.h"
+#include "memMgr.h"
+
+using namespace std;
+
+#define ALIGN_BLOCK (size_t(1) << 20)
+
+// 'B' Bytes of 4-Byte fields; its natural alignment is only 4
+template <size_t B>
+struct AlignObj
+{
+   unsigned  _d[B / sizeof(unsigned)];
+};
+
+template <size_t B>
+static size_t
+scanObj(const AlignObj<B>* p)
+{
+   size_t s = 0;
+   for (size_t k = 0; k < B / sizeof(unsigned); ++k) s += p->_d[k];
+   return s;
+}
+
+template <size_t B>
+static void
+runAlign(const char* mode, size_t a, bool noStraddle, size_t n,
+         const vector<size_t>& order, bool fit = false)
+{
+   MemMgr<AlignObj<B> > mgr(ALIGN_BLOCK);
+   mgr.setFit(fit);
+   mgr.setAlign(a);
+   mgr.setNoStraddle(noStraddle);
+   vector<AlignObj<B>*> objs(n);
+   size_t numStraddle = 0;
+   for (size_t i = 0; i < n; ++i) {
+      objs[i] = mgr.alloc(sizeof(AlignObj<B>));
+      for (size_t k = 0; k < B / sizeof(unsigned); ++k)
+         objs[i]->_d[k] = unsigned(i + k);
+      if (size_t(objs[i]) / MEM_LINE !=
+          (size_t(objs[i]) + B - 1) / MEM_LINE) ++numStraddle;
+   }
+   const size_t seqReps = 8, randReps = 2;
+   size_t sum = 0;
+   BenchTimer timer;
+   for (size_t r = 0; r < seqReps; ++r)
+      for (size_t i = 0; i < n; ++i) sum += scanObj(objs[i]);
+   double seqNs = timer.ns() / (n * seqReps);
+   timer.reset();
+   for (size_t r = 0; r < randReps; ++r)
+      for (size_t i = 0; i < n; ++i) sum += scanObj(objs[order[i]]);
+   double randNs = timer.ns() / (n * randReps);
+   benchKeep(sum);
+
+   string size = to_string(B);
+   benchRow("align", "seq" + size, mode, seqNs);
+   benchRow("align", "rand" + size, mode, randNs);
+   benchRow("align", "footprint" + size, mode,
+            double(mgr.getFootprint()) / n, "B/obj");
+   benchRow("align", "straddle" + size, mode, 100.0 * numStraddle / n, "%");
+}
+
+template <size_t B>
+static void
+runAlignAll(size_t n, const vector<size_t>& order)
+{
+   runAlign<B>("natural", 0, false, n, order);
+   runAlign<B>("no-straddle", 0, true, n, order);
+   runAlign<B>("align 32", 32, false, n, order);
+   runAlign<B>("align 64", 64, false, n, order);
+   // B/obj counts the aligned window each fit block is mapped in
+   runAlign<B>("fit", 0, false, n, order, true);
+}
+
+void
+benchAlign(size_t n)
+{
+   if (n == 0) n = 1 << 20;
+   vector<size_t> order(n);
+   for (size_t i = 0; i < n; ++i) order[i] = i;
+   shuffle(order.begin(), order.end(), mt19937(1));
+
+   benchTitle("align", n, "objects per run");
+   runAlignAll<24>(n, order);
+   runAlignAll<36>(n, order);
+   runAlignAll<64>(n, order);
+}
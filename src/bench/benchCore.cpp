@@ -0,0 +1,163 @@
+/****************************************************************************
+  FileName     [ benchCore.cpp ]
+  PackageName  [ bench ]
+  Synopsis     [ ns/op of the basic operations of MemMgr and of
+                 ::operator new ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <vector>
+#include <algorithm>
+#include <random>
+#include "bench.h"
+#include "memMgr.h"
+
+using namespace std;
+
+#define CORE_BATCH        1024
+#define CORE_BLOCK        65536
+#define CORE_SWITCH_BLOCK 4096
+#define CORE_SEED         1
+
+// The same 24 Bytes, pooled or not; the destructors make new[] keep
+// the array size
+class CoreObj
+{
+   USE_MEM_MGR(CoreObj);
+
+public:
+   ~CoreObj() {}
+   size_t  _d[3];
+};
+
+class CoreNewObj
+{
+public:
+   ~CoreNewObj() {}
+   size_t  _d[3];
+};
+
+MEM_MGR_INIT(CoreObj);
+
+// How each of them drops all its objects at once
+static void
+coreDropAll(vector<CoreObj*>&) { CoreObj::memReset(); }
+
+static void
+coreDropAll(vector<CoreNewObj*>& objs)
+{
+   for (size_t i = 0; i < objs.size(); ++i) delete objs[i];
+}
+
+// new/delete CORE_BATCH objects at a time, 'n' in all
+template <class T>
+static double
+runObj(size_t n)
+{
+   vector<T*> objs(CORE_BATCH);
+   size_t reps = n / CORE_BATCH + 1;
+   BenchTimer timer;
+   for (size_t r = 0; r < reps; ++r) {
+      for (size_t i = 0; i < CORE_BATCH; ++i) objs[i] = new T;
+      for (size_t i = 0; i < CORE_BATCH; ++i) delete objs[i];
+   }
+   return timer.ns() / (reps * CORE_BATCH);
+}
+
+// new[]/delete [] CORE_BATCH arrays of 'k' at a time, 'n' objects in all
+template <class T>
+static double
+runArr(size_t n, size_t k)
+{
+   vector<T*> objs(CORE_BATCH);
+   size_t reps = n / (k * CORE_BATCH) + 1;
+   BenchTimer timer;
+   for (size_t r = 0; r < reps; ++r) {
+      for (size_t i = 0; i < CORE_BATCH; ++i) objs[i] = new T[k];
+      for (size_t i = 0; i < CORE_BATCH; ++i) delete [] objs[i];
+   }
+   return timer.ns() / (reps * CORE_BATCH);
+}
+
+// new 'n' objects and delete them in the (seeded) random 'order', twice,
+// as MTNew and MTDelete -Random would
+template <class T>
+static double
+runRandom(size_t n, const vector<size_t>& order)
+{
+   vector<T*> objs(n);
+   BenchTimer timer;
+   for (size_t r = 0; r < 2; ++r) {
+      for (size_t i = 0; i < n; ++i) objs[i] = new T;
+      for (size_t i = 0; i < n; ++i) delete objs[order[i]];
+   }
+   return timer.ns() / (2 * n);
+}
+
+// new[] arrays of 'sizes', which mostly do not fit in what is left of
+// a CORE_SWITCH_BLOCK-Byte block, then delete [] them
+template <class T>
+static double
+runSwitch(const vector<size_t>& sizes)
+{
+   size_t n = sizes.size();
+   vector<T*> objs(n);
+   BenchTimer timer;
+   for (size_t i = 0; i < n; ++i) objs[i] = new T[sizes[i]];
+   for (size_t i = 0; i < n; ++i) delete [] objs[i];
+   return timer.ns() / n;
+}
+
+// new 'n' objects and drop them all; per object
+template <class T>
+static double
+runReset(size_t n)
+{
+   vector<T*> objs(n);
+   BenchTimer timer;
+   for (size_t i = 0; i < n; ++i) objs[i] = new T;
+   coreDropAll(objs);
+   return timer.ns() / n;
+}
+
+template <class T>
+static void
+runCore(const char* alloc, size_t n, const vector<size_t>& order,
+        const vector<size_t>& sizes)
+{
+   static const size_t arrSizes[] = { 1, 8, 64, 512 };
+   static const char* arrNames[] = { "arr1", "arr8", "arr64", "arr512" };
+   CoreObj::memReset();
+   benchRow("core", "obj", alloc, runObj<T>(n));
+   for (size_t j = 0; j < sizeof(arrSizes) / sizeof(size_t); ++j)
+      benchRow("core", arrNames[j], alloc, runArr<T>(n, arrSizes[j]));
+   CoreObj::memReset();
+   benchRow("core", "random", alloc, runRandom<T>(n, order));
+   CoreObj::memReset(CORE_SWITCH_BLOCK);
+   benchRow("core", "switch", alloc, runSwitch<T>(sizes));
+   CoreObj::memReset(CORE_BLOCK);
+   benchRow("core", "reset", alloc, runReset<T>(n));
+   CoreObj::memReset();
+}
+
+void
+benchCore(size_t n)
+{
+   if (n == 0) n = 1 << 20;
+   mt19937 gen(CORE_SEED);
+   vector<size_t> order(n);
+   for (size_t i = 0; i < n; ++i) order[i] = i;
+   shuffle(order.begin(), order.end(), gen);
+   // Arrays of 1/4 to 3/4 of a block
+   size_t q = CORE_SWITCH_BLOCK / sizeof(CoreObj) / 4;
+   uniform_int_distribution<size_t> dist(q, 3 * q);
+   vector<size_t> sizes(n / q + 1);
+   for (size_t i = 0; i < sizes.size(); ++i) sizes[i] = dist(gen);
+
+   benchTitle("core", n, "objects per run (ns/op)");
+   runCore<CoreObj>("MemMgr", n, order, sizes);
+   CoreObj::memSetHardened(true);
+   runCore<CoreObj>("hardened", n, order, sizes);
+   CoreObj::memSetHardened(false);
+   runCore<CoreNewObj>("new", n, order, sizes);
+}
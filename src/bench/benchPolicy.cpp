@@ -0,0 +1,88 @@
+/****************************************************************************
+  FileName     [ benchPolicy.cpp ]
+  PackageName  [ bench ]
+  Synopsis     [ Compare MemMgr<T> with a MemMgr<T, BlockSize, Policies...>
+                 whose parameters are all fixed at compile time ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <vector>
+#include "bench.h"
+#include "memMgr.h"
+
+using namespace std;
+
+#define POLICY_BATCH 1024
+
+typedef MemMgr<class PolicyFixedObj, 65536, MemThreads<MEM_THREAD_NONE>,
+               MemStats<false> > PolicyFixedMgr;
+// The fewest recycle lists allowed, with the thread caches
+typedef MemMgr<class PolicyClassObj, 65536, MemClasses<TC_SIZE, 1024, 2>,
+               MemThreads<MEM_THREAD_CACHE> > PolicyClassMgr;
+
+class PolicyRuntimeObj
+{
+   USE_MEM_MGR(PolicyRuntimeObj);
+
+public:
+   ~PolicyRuntimeObj() {}
+   size_t  _d[3];
+};
+
+class PolicyFixedObj
+{
+   USE_MEM_MGR_AS(PolicyFixedObj, PolicyFixedMgr);
+
+public:
+   ~PolicyFixedObj() {}
+   size_t  _d[3];
+};
+
+class PolicyClassObj
+{
+   USE_MEM_MGR_AS(PolicyClassObj, PolicyClassMgr);
+
+public:
+   ~PolicyClassObj() {}
+   size_t  _d[3];
+};
+
+MEM_MGR_INIT(PolicyRuntimeObj);
+MEM_MGR_INIT_AS(PolicyFixedObj, PolicyFixedMgr);
+MEM_MGR_INIT_AS(PolicyClassObj, PolicyClassMgr);
+
+// new/delete POLICY_BATCH objects, or arrays of 1 to 16, 'n' times over
+template <class T>
+static void
+runPolicy(const char* mode, size_t n)
+{
+   vector<T*> objs(POLICY_BATCH);
+   size_t reps = n / POLICY_BATCH + 1;
+   BenchTimer timer;
+   for (size_t r = 0; r < reps; ++r) {
+      for (size_t i = 0; i < POLICY_BATCH; ++i) objs[i] = new T;
+      for (size_t i = 0; i < POLICY_BATCH; ++i) delete objs[i];
+   }
+   double objNs = timer.ns() / (reps * POLICY_BATCH);
+   timer.reset();
+   for (size_t r = 0; r < reps; ++r) {
+      for (size_t i = 0; i < POLICY_BATCH; ++i)
+         objs[i] = new T[1 + i % 16];
+      for (size_t i = 0; i < POLICY_BATCH; ++i) delete [] objs[i];
+   }
+   double arrNs = timer.ns() / (reps * POLICY_BATCH);
+   T::memReset();
+
+   benchRow("policy", "obj", mode, objNs);
+   benchRow("policy", "arr1-16", mode, arrNs);
+}
+
+void
+benchPolicy(size_t n)
+{
+   if (n == 0) n = 1 << 24;
+   benchTitle("policy", n, "new/delete pairs per run");
+   runPolicy<PolicyRuntimeObj>("runtime", n);
+   runPolicy<PolicyFixedObj>("fixed", n);
+   runPolicy<PolicyClassObj>("classes", n);
+}
@@ -0,0 +1,67 @@
+/****************************************************************************
+  FileName     [ benchScope.cpp ]
+  PackageName  [ bench ]
+  Synopsis     [ Drop the objects of a request one by one, in a batch,
+                 or by rolling back to a mark ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "memMgr.h"
+
+using namespace std;
+
+#define SCOPE_BLOCK (size_t(1) << 20)
+#define SCOPE_REQS  32
+
+struct ScopeObj
+{
+   size_t  _d[5];
+};
+
+enum ScopeDrop { SCOPE_FREE, SCOPE_BATCH, SCOPE_ROLLBACK };
+
+// SCOPE_REQS requests of 'n' objects each, on top of 'n' live ones
+static void
+runScope(const char* mode, ScopeDrop drop, size_t n)
+{
+   MemMgr<ScopeObj> mgr(SCOPE_BLOCK);
+   vector<ScopeObj*> base(n), objs(n);
+   mgr.allocBatch(n, &(base[0]));
+   double allocNs = 0, dropNs = 0;
+   size_t sum = 0;
+   for (size_t r = 0; r < SCOPE_REQS; ++r) {
+      BenchTimer timer;
+      size_t m = (drop == SCOPE_ROLLBACK)? mgr.mark(): 0;
+      for (size_t i = 0; i < n; ++i) {
+         objs[i] = mgr.alloc(sizeof(ScopeObj));
+         objs[i]->_d[0] = i;
+      }
+      allocNs += timer.ns();
+      for (size_t i = 0; i < n; i += 64) sum += objs[i]->_d[0];
+      timer.reset();
+      if (drop == SCOPE_FREE)
+         for (size_t i = 0; i < n; ++i) mgr.free(objs[i]);
+      else if (drop == SCOPE_BATCH) mgr.freeBatch(n, &(objs[0]));
+      else mgr.rollback(m);
+      dropNs += timer.ns();
+   }
+   benchKeep(sum);
+
+   benchRow("scope", "alloc", mode, allocNs / (n * SCOPE_REQS));
+   benchRow("scope", "drop", mode, dropNs / (n * SCOPE_REQS));
+   benchRow("scope", "blocks", mode, double(mgr.getNumBlocks()), "blocks");
+}
+
+void
+benchScope(size_t n)
+{
+   if (n == 0) n = 1 << 16;
+   benchTitle("scope", n, "objects in each of " + to_string(SCOPE_REQS) +
+              " requests");
+   runScope("free", SCOPE_FREE, n);
+   runScope("batch", SCOPE_BATCH, n);
+   runScope("rollback", SCOPE_ROLLBACK, n);
+}
@@ -0,0 +1,92 @@
+/****************************************************************************
+  FileName     [ benchShared.cpp ]
+  PackageName  [ bench ]
+  Synopsis     [ Footprint of many small pooled types, each with its own
+                 MemMgr or all in one shared arena ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "memMgr.h"
+
+using namespace std;
+
+#define SHARED_TYPES 16
+
+// SHARED_TYPES types of 33 to 40 Bytes, all rounded up to 40
+template <int I>
+class SharedObj
+{
+   USE_MEM_MGR(SharedObj);
+
+public:
+   ~SharedObj() {}
+   static size_t numBlocks() { return _memMgr->getNumBlocks(); }
+   static size_t footprint() { return _memMgr->getFootprint(); }
+
+private:
+   char  _d[33 + I % 8];
+};
+
+template <int I>
+MemMgr<SharedObj<I> >* const SharedObj<I>::_memMgr =
+   new MemMgr<SharedObj<I> >;
+
+// Allocate 'n' objects of type I, keep one in 'k' of them, and go on
+// with the types after it, which may reuse what type I has freed.
+// Return the #blocks of the own managers, and add their footprint to
+// 'bytes'.
+template <int I>
+struct SharedRun
+{
+   static size_t run(size_t n, size_t k, bool shared, size_t& bytes) {
+      SharedObj<I>::memSetShared(shared);
+      vector<SharedObj<I>*> objs;
+      for (size_t i = 0; i < n; ++i) objs.push_back(new SharedObj<I>);
+      for (size_t i = 0; i < n; ++i)
+         if (i % k != 0) delete objs[i];
+      size_t blocks = SharedRun<I + 1>::run(n, k, shared, bytes);
+      blocks += shared? 0: SharedObj<I>::numBlocks();
+      bytes += shared? 0: SharedObj<I>::footprint();
+      for (size_t i = 0; i < n; i += k) delete objs[i];
+      SharedObj<I>::memReset();
+      return blocks;
+   }
+};
+
+template <>
+struct SharedRun<SHARED_TYPES>
+{
+   static size_t run(size_t, size_t, bool, size_t&) { return 0; }
+};
+
+static void
+runShared(const char* mode, size_t n, size_t k, bool shared)
+{
+   typedef MemRawOf<SharedObj<0> >::Type Raw;
+   const MemMgr<Raw>* arena = memArena<Raw>();
+   size_t arenaBlocks = arena->getNumBlocks();
+   size_t bytes = 0;
+   BenchTimer timer;
+   size_t blocks = SharedRun<0>::run(n, k, shared, bytes);
+   double ns = timer.ns() / (n * SHARED_TYPES);
+   if (shared) {
+      blocks = arena->getNumBlocks() - arenaBlocks + 1;
+      bytes = blocks * arena->getFootprint() / arena->getNumBlocks();
+   }
+   benchRow("shared", "obj", mode, ns);
+   benchRow("shared", "blocks", mode, double(blocks), "blocks");
+   benchRow("shared", "footprint", mode, double(bytes / 1024), "KBytes");
+}
+
+void
+benchShared(size_t n)
+{
+   if (n == 0) n = 4096;
+   benchTitle("shared", n, "objects of each of " + to_string(SHARED_TYPES) +
+              " types, 1/16 kept live");
+   runShared("own", n, 16, false);
+   runShared("shared", n, 16, true);
+}
@@ -0,0 +1,74 @@
+/****************************************************************************
+  FileName     [ benchStl.cpp ]
+  PackageName  [ bench ]
+  Synopsis     [ Churn the nodes of STL containers through the global
+                 heap, MemAllocator and MemResource ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <map>
+#include <list>
+#include "bench.h"
+#include "memAlloc.h"
+
+using namespace std;
+
+#define STL_KEYS 65536
+
+// Insert, look up and erase 'n' keys in map 'm' and list 'l'; ns per key
+template <class M, class L>
+static void
+runStl(const char* mode, size_t n, M& m, L& l)
+{
+   size_t sum = 0;
+   BenchTimer timer;
+   for (size_t i = 0; i < n; ++i) {
+      size_t k = (i * 40503) % STL_KEYS;
+      typename M::iterator it = m.find(k);
+      if (it == m.end()) m.insert(make_pair(k, i));
+      else { sum += it->second; m.erase(it); }
+   }
+   double mapNs = timer.ns() / n;
+   timer.reset();
+   for (size_t i = 0; i < n; ++i) {
+      l.push_back(i);
+      if (l.size() > STL_KEYS) { sum += l.front(); l.pop_front(); }
+   }
+   double listNs = timer.ns() / n;
+   benchKeep(sum);
+
+   benchRow("stl", "map", mode, mapNs);
+   benchRow("stl", "list", mode, listNs);
+}
+
+void
+benchStl(size_t n)
+{
+   if (n == 0) n = 1 << 23;
+   benchTitle("stl", n, "keys per run");
+   {
+      map<size_t, size_t> m;
+      list<size_t> l;
+      runStl("std::allocator", n, m, l);
+   }
+   {
+      map<size_t, size_t, less<size_t>,
+          MemAllocator<pair<const size_t, size_t> > > m;
+      list<size_t, MemAllocator<size_t> > l;
+      runStl("MemAllocator", n, m, l);
+   }
+#if __cplusplus >= 201703L
+   {
+      pmr::unsynchronized_pool_resource r;
+      pmr::map<size_t, size_t> m(&r);
+      pmr::list<size_t> l(&r);
+      runStl("pmr pool", n, m, l);
+   }
+   {
+      MemResource r;
+      pmr::map<size_t, size_t> m(&r);
+      pmr::list<size_t> l(&r);
+      runStl("MemResource", n, m, l);
+   }
+#endif // __cplusplus >= 201703L
+}
@@ -0,0 +1,97 @@
+/****************************************************************************
+  FileName     [ memBench.cpp ]
+  PackageName  [ bench ]
+  Synopsis     [ main() of memBench ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include "bench.h"
+
+using namespace std;
+
+volatile size_t benchSink = 0;
+bool benchCsv = false;
+
+void
+benchTitle(const char* bench, size_t n, const string& what)
+{
+   if (benchCsv) return;
+   cout << "== " << bench << ": " << n << " " << what << endl
+        << "  case        allocator              value  unit" << endl;
+}
+
+void
+benchRow(const char* bench, const string& kase, const char* alloc,
+         double value, const char* unit)
+{
+   if (benchCsv)
+      cout << bench << "," << kase << "," << alloc << "," << fixed
+           << setprecision(2) << value << "," << unit << endl;
+   else
+      cout << "  " << setw(12) << left << kase << setw(16) << alloc << right
+           << fixed << setprecision(2) << setw(12) << value << "  " << unit
+           << endl;
+   cout.unsetf(ios::floatfield);
+}
+
+struct BenchEntry
+{
+   const char*  _name;
+   void         (*_run)(size_t);
+};
+
+static const BenchEntry benchList[] = {
+   { "align", benchAlign },
+   { "core", benchCore },
+   { "policy", benchPolicy },
+   { "scope", benchScope },
+   { "shared", benchShared },
+   { "stl", benchStl }
+};
+static const size_t numBench = sizeof(benchList) / sizeof(BenchEntry);
+
+static void
+usage()
+{
+   cout << "Usage: memBench [-Csv] [(size_t numObjects)] [benchName...]"
+        << endl << "Benchmarks:";
+   for (size_t i = 0; i < numBench; ++i)
+      cout << " " << benchList[i]._name;
+   cout << endl << "(-Csv: as \"bench,case,allocator,value,unit\" rows)"
+        << endl;
+}
+
+int
+main(int argc, char** argv)
+{
+   size_t n = 0;
+   int i = 1;
+   if (i < argc && strcmp(argv[i], "-Csv") == 0) {
+      benchCsv = true;
+      ++i;
+      cout << "bench,case,allocator,value,unit" << endl;
+   }
+   if (i < argc && isdigit(argv[i][0]))
+      n = strtoul(argv[i++], 0, 10);
+   if (i == argc) {  // run them all
+      for (size_t j = 0; j < numBench; ++j)
+         benchList[j]._run(n);
+      return 0;
+   }
+   for (; i < argc; ++i) {
+      size_t j = 0;
+      while (j < numBench && strcmp(argv[i], benchList[j]._name) != 0) ++j;
+      if (j == numBench) {
+         cerr << "Error: unknown benchmark \"" << argv[i] << "\"!!" << endl;
+         usage();
+         return 1;
+      }
+      benchList[j]._run(n);
+   }
+   return 0;
+}
@@ -1,4 +1,4 @@
 memCmd.o: memCmd.cpp memCmd.h ../../include/cmdParser.h \
- ../../include/cmdCharDef.h memTest.h memMgr.h ../../include/util.h \
- ../../include/rnGen.h ../../include/myUsage.h
-memTest.o: memTest.cpp memTest.h memMgr.h
+ ../../include/cmdCharDef.h memTest.h memMgr.h memTrace.h \
+ ../../include/util.h ../../include/rnGen.h ../../include/myUsage.h
+memTest.o: memTest.cpp memTest.h memMgr.h memTrace.h
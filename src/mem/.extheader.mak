@@ -1 +1,13 @@
-mem.d: 
+mem.d: ../../include/memMgr.h ../../include/memAlloc.h ../../include/memTrace.h ../../include/memLog.h 
+../../include/memMgr.h: memMgr.h
+	@rm -f ../../include/memMgr.h
+	@ln -fs ../src/mem/memMgr.h ../../include/memMgr.h
+../../include/memAlloc.h: memAlloc.h
+	@rm -f ../../include/memAlloc.h
+	@ln -fs ../src/mem/memAlloc.h ../../include/memAlloc.h
+../../include/memTrace.h: memTrace.h
+	@rm -f ../../include/memTrace.h
+	@ln -fs ../src/mem/memTrace.h ../../include/memTrace.h
+../../include/memLog.h: memLog.h
+	@rm -f ../../include/memLog.h
+	@ln -fs ../src/mem/memLog.h ../../include/memLog.h
@@ -0,0 +1,132 @@
+/****************************************************************************
+  FileName     [ memAlloc.h ]
+  PackageName  [ mem ]
+  Synopsis     [ Define the STL allocator and the memory resource over
+                 MemMgr ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+
+#ifndef MEM_ALLOC_H
+#define MEM_ALLOC_H
+
+#include <new>
+#include <cstddef>
+#include "memMgr.h"
+
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+using namespace std;
+
+//--------------------------------------------------------------------------
+// Raw arrays
+//--------------------------------------------------------------------------
+// Allocate 'b' Bytes as an array of the raw elements (of 's' Bytes) of
+// 'm', with the array size in front as new[] would do
+template <class M>
+inline void* memRawAllocArr(M* m, size_t b, size_t s)
+{
+   if (b > size_t(-1) - SIZE_T - s) throw bad_alloc();
+   size_t n = (b + s - 1) / s;
+   size_t* p = (size_t*)(m->allocArr(n * s + SIZE_T));
+   *p = n;
+   return p + 1;
+}
+
+template <class M, class R>
+inline void memRawFreeArr(M* m, void* p)
+{
+   m->freeArr((R*)((size_t*)p - 1));
+}
+
+//--------------------------------------------------------------------------
+// STL allocator
+//--------------------------------------------------------------------------
+// Allocate the U's of a container from the arena of every type of the
+// same rounded size and alignment (see memArena()), which the classes
+// in shared mode use too; e.g.
+//    map<int, int, less<int>, MemAllocator<pair<const int, int> > > m;
+// Single elements (the nodes of list, map, set...) come from the object
+// list, and n > 1 elements (vector, deque...) from the array lists.
+// Arrays too big for a block are mapped as large objects.
+// The arenas are single-threaded.
+//
+template <class U>
+class MemAllocator
+{
+public:
+   typedef typename MemRawOf<U>::Type  Raw;
+   typedef MemMgr<Raw>                 Mgr;
+   typedef U                           value_type;
+
+   MemAllocator() {}
+   template <class V> MemAllocator(const MemAllocator<V>&) {}
+
+   U* allocate(size_t n) {
+      if (n <= 1) return (U*)(getMemMgr()->alloc(sizeof(Raw)));
+      if (n > size_t(-1) / sizeof(U)) throw bad_alloc();
+      return (U*)memRawAllocArr(getMemMgr(), n * sizeof(U), sizeof(Raw));
+   }
+   void deallocate(U* p, size_t n) {
+      if (n <= 1) getMemMgr()->free((Raw*)p);
+      else memRawFreeArr<Mgr, Raw>(getMemMgr(), p);
+   }
+
+   static Mgr* getMemMgr() { return memArena<Raw>(); }
+};
+
+template <class U, class V>
+inline bool operator == (const MemAllocator<U>&, const MemAllocator<V>&)
+{ return true; }
+
+template <class U, class V>
+inline bool operator != (const MemAllocator<U>&, const MemAllocator<V>&)
+{ return false; }
+
+#if __cplusplus >= 201703L
+//--------------------------------------------------------------------------
+// Polymorphic memory resource (C++17)
+//--------------------------------------------------------------------------
+// Serve any size from one MemMgr of SIZE_T units: 'b' Bytes are an array
+// of ceil(b / SIZE_T) units, so each size has its own exact recycle list.
+// Alignments up to alignof(max_align_t) are served; bigger ones go to the
+// upstream resource. Not thread-safe, like unsynchronized_pool_resource;
+// all is released when the resource is destroyed.
+//
+class MemResource : public pmr::memory_resource
+{
+public:
+   typedef MemRaw<SIZE_T, SIZE_T>  Unit;
+   typedef MemMgr<Unit>            Mgr;
+
+   MemResource(size_t b = 65536,
+               pmr::memory_resource* u = pmr::get_default_resource())
+   : _mgr(b), _upstream(u) {
+      _mgr.setAlign(alignof(max_align_t));
+      _mgr.setLargeObj(true);
+   }
+
+   Mgr* getMemMgr() { return &_mgr; }
+   pmr::memory_resource* upstream_resource() const { return _upstream; }
+
+protected:
+   void* do_allocate(size_t b, size_t a) override {
+      if (a > _mgr.getAlign()) return _upstream->allocate(b, a);
+      return memRawAllocArr(&_mgr, b? b: 1, SIZE_T);
+   }
+   void do_deallocate(void* p, size_t b, size_t a) override {
+      if (a > _mgr.getAlign()) _upstream->deallocate(p, b, a);
+      else memRawFreeArr<Mgr, Unit>(&_mgr, p);
+   }
+   bool do_is_equal(const pmr::memory_resource& r) const noexcept override {
+      return this == &r; }
+
+private:
+   Mgr                     _mgr;
+   pmr::memory_resource*   _upstream;
+};
+#endif // __cplusplus >= 201703L
+
+#endif // MEM_ALLOC_H
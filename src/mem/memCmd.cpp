@@ -7,6 +7,11 @@
 ****************************************************************************/
 #include <iostream>
 #include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstring>
 #include "memCmd.h"
 #include "memTest.h"
 #include "cmdParser.h"
@@ -22,7 +27,14 @@ initMemCmd()
    if (!(cmdMgr->regCmd("MTReset", 3, new MTResetCmd) &&
          cmdMgr->regCmd("MTNew", 3, new MTNewCmd) &&
          cmdMgr->regCmd("MTDelete", 3, new MTDeleteCmd) &&
-         cmdMgr->regCmd("MTPrint", 3, new MTPrintCmd)
+         cmdMgr->regCmd("MTPrint", 3, new MTPrintCmd) &&
+         cmdMgr->regCmd("MTMark", 3, new MTMarkCmd) &&
+         cmdMgr->regCmd("MTRollback", 4, new MTRollbackCmd) &&
+         cmdMgr->regCmd("MTStat", 3, new MTStatCmd) &&
+         cmdMgr->regCmd("MTTrace", 3, new MTTraceCmd) &&
+         cmdMgr->regCmd("MTLog", 3, new MTLogCmd) &&
+         cmdMgr->regCmd("MTBench", 3, new MTBenchCmd) &&
+         cmdMgr->regCmd("MTUsage", 3, new MTUsageCmd)
       )) {
       cerr << "Registering \"mem\" commands fails... exiting" << endl;
       return false;
@@ -32,36 +44,243 @@ initMemCmd()
 
 
 //----------------------------------------------------------------------
-//    MTReset [(size_t blockSize)]
+// -Random of MTDelete
+//----------------------------------------------------------------------
+// rnGen() in [0, n), n > 0 (rnGen(n) itself may be n, if rarely)
+static size_t
+mtRandom(size_t n)
+{
+   return min(size_t(rnGen(int(n))), n - 1);
+}
+
+// Delete 'n' live objects (arrays) at random, or all if there are fewer
+// (MTDelete -Random)
+static void
+mtDeleteRandom(bool arr, size_t n)
+{
+   const vector<size_t>& live = arr? mtest.getLiveArrs(): mtest.getLiveObjs();
+   for (; n > 0 && !live.empty(); --n) {
+      if (arr) mtest.deleteArr(live[mtRandom(live.size())]);
+      else mtest.deleteObj(live[mtRandom(live.size())]);
+   }
+}
+
+
+//----------------------------------------------------------------------
+// -Threads k of MTNew and MTDelete (see MemTest::newObjsMT())
+//----------------------------------------------------------------------
+#define MT_MAX_THREADS 256
+
+enum MTThreadsOp
+{
+   MT_THREADS_NEW     = 0,
+   MT_THREADS_NEW_ARR = 1,
+   MT_THREADS_DEL     = 2,
+   MT_THREADS_DEL_ARR = 3,
+
+   // dummy
+   MT_THREADS_TOT
+};
+
+// Mops/s of the last 1-thread run of each operation since MTReset,
+// which the k-thread runs are compared to
+static double mtThreadsBase[MT_THREADS_TOT];
+
+static void
+mtThreadsClear()
+{
+   for (size_t i = 0; i < MT_THREADS_TOT; ++i) mtThreadsBase[i] = 0;
+}
+
+// Take "-Threads k" out of 'tokens' into 'k' (0 if none). On an error,
+// return it (CMD_OPT_ERROR_TOT if none) with the token in 'bad'.
+static CmdOptionError
+mtThreadsLex(vector<string>& tokens, int& k, string& bad)
+{
+   k = 0;
+   for (size_t i = 0; i < tokens.size(); ++i) {
+      if (myStrNCmp("-Threads", tokens[i], 2) != 0) continue;
+      bad = tokens[i];
+      if (k != 0) return CMD_OPT_EXTRA;
+      if (i + 1 == tokens.size()) return CMD_OPT_MISSING;
+      bad = tokens[i + 1];
+      if (!myStr2Int(bad, k) || k <= 0 || k > MT_MAX_THREADS)
+         return CMD_OPT_ILLEGAL;
+      tokens.erase(tokens.begin() + i, tokens.begin() + i + 2);
+      --i;
+   }
+   return CMD_OPT_ERROR_TOT;
+}
+
+// Report the aggregate throughput of 'numOps' operations in 'ns' by k
+// threads, and its scaling efficiency: the throughput over k times that
+// of 1 thread
+static void
+mtThreadsReport(MTThreadsOp op, size_t k, size_t numOps, double ns)
+{
+   static const char* names[] = { "new", "new[]", "delete", "delete[]" };
+   double mops = (ns > 0)? numOps * 1e3 / ns: 0;
+   cout << k << " thread(s) " << (mtest.isThreadSafe()? "cached": "locked")
+        << ": " << numOps << " " << names[op] << " in " << fixed
+        << setprecision(3) << ns / 1e6 << " ms, " << setprecision(2)
+        << mops << " Mops/s";
+   if (k == 1) mtThreadsBase[op] = mops;
+   else if (mtThreadsBase[op] > 0)
+      cout << ", " << setprecision(0) << 100 * mops / (k * mtThreadsBase[op])
+           << "% scaling efficiency";
+   else cout << " (no 1-thread run to compare with)";
+   cout << endl;
+   cout.unsetf(ios::floatfield);
+   cout.precision(6);
+}
+
+static void
+mtThreadsNew(size_t n, size_t s, size_t k)
+{
+   if (s == 0)
+      mtThreadsReport(MT_THREADS_NEW, k, n, mtest.newObjsMT(n, k));
+   else
+      mtThreadsReport(MT_THREADS_NEW_ARR, k, n, mtest.newArrsMT(n, s, k));
+}
+
+static void
+mtThreadsDelete(const vector<size_t>& idx, bool arr, size_t k)
+{
+   if (!arr)
+      mtThreadsReport(MT_THREADS_DEL, k, idx.size(),
+                      mtest.deleteObjsMT(idx, k));
+   else
+      mtThreadsReport(MT_THREADS_DEL_ARR, k, idx.size(),
+                      mtest.deleteArrsMT(idx, k));
+}
+
+// Delete 'n' distinct live objects (arrays) at random, or all if there
+// are fewer
+static void
+mtThreadsDeleteRandom(bool arr, size_t n, size_t k)
+{
+   vector<size_t> idx(arr? mtest.getLiveArrs(): mtest.getLiveObjs());
+   if (n > idx.size()) n = idx.size();
+   for (size_t i = 0; i < n; ++i)
+      swap(idx[i], idx[i + mtRandom(idx.size() - i)]);
+   idx.resize(n);
+   mtThreadsDelete(idx, arr, k);
+}
+
+
+//----------------------------------------------------------------------
+//    MTReset [(size_t blockSize)] [-Large] [-Release] [-Fit]
+//            [-Store <New | Mmap | Huge>]
+//            [-Align (size_t align)] [-NoStraddle] [-SHared] [-Hardened]
+//            [-Thread <None | Cache>]
 //----------------------------------------------------------------------
 CmdExecStatus
 MTResetCmd::exec(const string& option)
 {
    // check option
-   string token;
-   if (!CmdExec::lexSingleOption(option, token))
+   vector<string> options;
+   if (!CmdExec::lexOptions(option, options))
       return CMD_EXEC_ERROR;
+   string token;
+   bool large = false, release = false, fit = false, hasStore = false;
+   bool noStraddle = false, shared = false, hardened = false;
+   bool hasThread = false;
+   MemStore store = MEM_STORE_NEW;
+   MemThreadMode thread = MEM_THREAD_NONE;
+   string alignStr;
+   for (size_t i = 0, n = options.size(); i < n; ++i) {
+      bool* flag = 0;
+      if (myStrNCmp("-Large", options[i], 2) == 0) flag = &large;
+      else if (myStrNCmp("-Release", options[i], 2) == 0) flag = &release;
+      else if (myStrNCmp("-Fit", options[i], 2) == 0) flag = &fit;
+      else if (myStrNCmp("-NoStraddle", options[i], 2) == 0)
+         flag = &noStraddle;
+      else if (myStrNCmp("-SHared", options[i], 3) == 0) flag = &shared;
+      else if (myStrNCmp("-Hardened", options[i], 2) == 0) flag = &hardened;
+      else if (myStrNCmp("-Align", options[i], 2) == 0) {
+         if (alignStr.size())
+            return CmdExec::errorOption(CMD_OPT_EXTRA, options[i]);
+         if (i + 1 == n)
+            return CmdExec::errorOption(CMD_OPT_MISSING, options[i]);
+         alignStr = options[++i];
+         continue;
+      }
+      else if (myStrNCmp("-Store", options[i], 2) == 0) {
+         if (hasStore)
+            return CmdExec::errorOption(CMD_OPT_EXTRA, options[i]);
+         if (i + 1 == n)
+            return CmdExec::errorOption(CMD_OPT_MISSING, options[i]);
+         hasStore = true;
+         ++i;
+         if (myStrNCmp("New", options[i], 1) == 0) store = MEM_STORE_NEW;
+         else if (myStrNCmp("Mmap", options[i], 1) == 0) store = MEM_STORE_MMAP;
+         else if (myStrNCmp("Huge", options[i], 1) == 0) store = MEM_STORE_HUGE;
+         else return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[i]);
+         continue;
+      }
+      else if (myStrNCmp("-Thread", options[i], 2) == 0) {
+         if (hasThread)
+            return CmdExec::errorOption(CMD_OPT_EXTRA, options[i]);
+         if (i + 1 == n)
+            return CmdExec::errorOption(CMD_OPT_MISSING, options[i]);
+         hasThread = true;
+         ++i;
+         if (myStrNCmp("None", options[i], 1) == 0) thread = MEM_THREAD_NONE;
+         else if (myStrNCmp("Cache", options[i], 1) == 0)
+            thread = MEM_THREAD_CACHE;
+         else return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[i]);
+         continue;
+      }
+      if (flag != 0) {
+         if (*flag)
+            return CmdExec::errorOption(CMD_OPT_EXTRA, options[i]);
+         *flag = true;
+      }
+      else if (token.size())
+         return CmdExec::errorOption(CMD_OPT_EXTRA, options[i]);
+      else
+         token = options[i];
+   }
+   int b = 0;
    if (token.size()) {
-      int b;
       if (!myStr2Int(token, b) || b < int(toSizeT(sizeof(MemTestObj)))) {
          cerr << "Illegal block size (" << token << ")!!" << endl;
          return CmdExec::errorOption(CMD_OPT_ILLEGAL, token);
       }
-      #ifdef MEM_MGR_H
-      mtest.reset(toSizeT(b));
-      #else
-      mtest.reset();
-      #endif // MEM_MGR_H
    }
-   else
-      mtest.reset();
+   int align = 0;
+   if (alignStr.size()) {
+      if (!myStr2Int(alignStr, align) || align <= 0 || (align & (align - 1)))
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, alignStr);
+   }
+   // First, as switching it deletes the objects
+   mtest.setShared(shared);
+   mtest.setThreadMode(thread);
+   mtest.setLargeObj(large);
+   mtest.setReleaseEmpty(release);
+   mtest.setFit(fit);
+   mtest.setStore(store);
+   mtest.setNoStraddle(noStraddle);
+   mtest.setAlign(size_t(align));
+   mtest.setHardened(hardened);
+   #ifdef MEM_MGR_H
+   mtest.reset(toSizeT(b));
+   #else
+   mtest.reset();
+   #endif // MEM_MGR_H
+   mtThreadsClear();
    return CMD_EXEC_DONE;
 }
 
 void
 MTResetCmd::usage(ostream& os) const
 {
-   os << "Usage: MTReset [(size_t blockSize)]" << endl;
+   os << "Usage: MTReset [(size_t blockSize)] [-Large] [-Release] [-Fit]"
+      << endl
+      << "               [-Store <New | Mmap | Huge>] [-Align (size_t align)]"
+      << endl
+      << "               [-NoStraddle] [-SHared] [-Hardened]" << endl
+      << "               [-Thread <None | Cache>]" << endl;
 }
 
 void
@@ -74,6 +293,7 @@ MTResetCmd::help() const
 
 //----------------------------------------------------------------------
 //    MTNew <(size_t numObjects)> [-Array (size_t arraySize)]
+//          [-Threads (size_t k)]
 //----------------------------------------------------------------------
 CmdExecStatus
 MTNewCmd::exec(const string& option)
@@ -83,16 +303,16 @@ MTNewCmd::exec(const string& option)
 
      vector<string> tokens;
      CmdExec::lexOptions(option, tokens, 0);
+     int k;
+     string bad;
+     CmdOptionError err = mtThreadsLex(tokens, k, bad);
+     if (err != CMD_OPT_ERROR_TOT) return CmdExec::errorOption(err, bad);
      if (tokens.size() == 1){ //numObjects
        int num;
-       size_t num1 = num;
-       if (myStr2Int(tokens[0], num)){
-         num1 = num;
-         mtest.newObjs(num1);
-       }
-       else {
-         CmdExec::errorOption(CMD_OPT_ILLEGAL, tokens[0]);
-       }
+       if (!myStr2Int(tokens[0], num) || num <= 0)
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, tokens[0]);
+       if (k) mtThreadsNew(size_t(num), 0, k);
+       else mtest.newObjs(size_t(num));
      }
      else if (tokens.size() == 3){ //plus -Array
        if (myStrNCmp("-Array", tokens[0], 2) == 0){ //first token is -Array
@@ -101,8 +321,11 @@ MTNewCmd::exec(const string& option)
            if (formerInt <= 0){
              CmdExec::errorOption(CMD_OPT_ILLEGAL, tokens[1]);
            }
+           else if (latterInt <= 0)
+             return CmdExec::errorOption(CMD_OPT_ILLEGAL, tokens[2]);
            else {
-             mtest.newArrs(latterInt, formerInt);
+             if (k) mtThreadsNew(latterInt, formerInt, k);
+             else mtest.newArrs(latterInt, formerInt);
            }
          }
          else { //options not good
@@ -115,8 +338,11 @@ MTNewCmd::exec(const string& option)
            if (latterInt <= 0){
              CmdExec::errorOption(CMD_OPT_ILLEGAL, tokens[2]);
            }
+           else if (formerInt <= 0)
+             return CmdExec::errorOption(CMD_OPT_ILLEGAL, tokens[0]);
            else {
-             mtest.newArrs(formerInt, latterInt);
+             if (k) mtThreadsNew(formerInt, latterInt, k);
+             else mtest.newArrs(formerInt, latterInt);
            }
          }
          else {
@@ -143,7 +369,8 @@ MTNewCmd::exec(const string& option)
 void
 MTNewCmd::usage(ostream& os) const
 {
-   os << "Usage: MTNew <(size_t numObjects)> [-Array (size_t arraySize)]\n";
+   os << "Usage: MTNew <(size_t numObjects)> [-Array (size_t arraySize)]\n"
+      << "             [-Threads (size_t k)]\n";
 }
 
 void
@@ -155,7 +382,9 @@ MTNewCmd::help() const
 
 
 //----------------------------------------------------------------------
-//    MTDelete <-Index (size_t objId) | -Random (size_t numRandId)> [-Array]
+//    MTDelete <-Index (size_t objId) [-Keep] | -Random (size_t numRandId) |
+//              -Range (size_t from) (size_t to)> [-Array]
+//             [-Threads (size_t k)]
 //----------------------------------------------------------------------
 CmdExecStatus
 MTDeleteCmd::exec(const string& option)
@@ -163,6 +392,75 @@ MTDeleteCmd::exec(const string& option)
    // TODO
    vector<string> tokens;
    CmdExec::lexOptions(option, tokens, 0);
+   // -Threads: -Random and -Range only
+   int k;
+   string bad;
+   CmdOptionError err = mtThreadsLex(tokens, k, bad);
+   if (err != CMD_OPT_ERROR_TOT) return CmdExec::errorOption(err, bad);
+   for (size_t i = 0; k && i < tokens.size(); ++i)
+      if (myStrNCmp("-Index", tokens[i], 2) == 0)
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, tokens[i]);
+   // -Keep: -Index only; the pointer stays in the list, to be deleted
+   // again as a double free. Only a hardened manager catches that, so
+   // it is illegal otherwise (see MTReset -Hardened).
+   bool keep = false, hasIndex = false;
+   string keepStr;
+   for (size_t i = 0; i < tokens.size(); ) {
+      if (myStrNCmp("-Keep", tokens[i], 2) == 0) {
+         if (keep) return CmdExec::errorOption(CMD_OPT_EXTRA, tokens[i]);
+         keep = true;
+         keepStr = tokens[i];
+         tokens.erase(tokens.begin() + i);
+         continue;
+      }
+      if (myStrNCmp("-Index", tokens[i], 2) == 0) hasIndex = true;
+      ++i;
+   }
+   if (keep && (!hasIndex || !mtest.isHardened()))
+      return CmdExec::errorOption(CMD_OPT_ILLEGAL, keepStr);
+   // -Range: delete the objects (arrays) in [from, to) in one batch
+   // ("-R" to "-Ran" still mean -Random)
+   bool doRange = false;
+   for (size_t i = 0; i < tokens.size(); ++i)
+      if (myStrNCmp("-Range", tokens[i], 5) == 0) doRange = true;
+   if (doRange) {
+      bool doArr = false;
+      vector<string> opts;
+      for (size_t i = 0, n = tokens.size(); i < n; ++i) {
+         if (myStrNCmp("-Array", tokens[i], 2) == 0) {
+            if (doArr)
+               return CmdExec::errorOption(CMD_OPT_EXTRA, tokens[i]);
+            doArr = true;
+         }
+         else
+            opts.push_back(tokens[i]);
+      }
+      if (myStrNCmp("-Range", opts[0], 5) != 0)
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, opts[0]);
+      if (opts.size() < 3)
+         return CmdExec::errorOption(CMD_OPT_MISSING, opts.back());
+      if (opts.size() > 3)
+         return CmdExec::errorOption(CMD_OPT_EXTRA, opts[3]);
+      int from, to;
+      if (!myStr2Int(opts[1], from) || from < 0)
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, opts[1]);
+      if (!myStr2Int(opts[2], to) || to < from)
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, opts[2]);
+      size_t n = doArr? mtest.getArrListSize(): mtest.getObjListSize();
+      if (size_t(to) > n) {
+         cerr << "Size of " << (doArr? "array": "object") << " list (" << n
+              << ") is < " << to << endl;
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, opts[2]);
+      }
+      if (k) {
+         vector<size_t> idx;
+         mtest.getLive(doArr, from, to, idx);
+         mtThreadsDelete(idx, doArr, k);
+      }
+      else if (doArr) mtest.deleteArrs(from, to);
+      else mtest.deleteObjs(from, to);
+      return CMD_EXEC_DONE;
+   }
    //debug ===================
    //cout << "size of tokens is " << tokens.size() << endl;
    //for (int i = 0; i < tokens.size(); i++){
@@ -181,7 +479,7 @@ MTDeleteCmd::exec(const string& option)
            CmdExec::errorOption(CMD_OPT_ILLEGAL, tokens[1]);
          }
          else {
-           mtest.deleteObj(objIdx);
+           mtest.deleteObj(objIdx, keep);
          }
        }
        else {
@@ -195,9 +493,8 @@ MTDeleteCmd::exec(const string& option)
            cerr << "Size of object list is 0!!" << endl;
          }
          else {
-           for (int i = 0; i < numOfRand; i++){
-             mtest.deleteObj(rnGen(mtest.getObjListSize()));
-           }
+           if (k) mtThreadsDeleteRandom(false, numOfRand, k);
+           else mtDeleteRandom(false, numOfRand);
          }
        }
        else {
@@ -221,7 +518,7 @@ MTDeleteCmd::exec(const string& option)
              CmdExec::errorOption(CMD_OPT_ILLEGAL, tokens[2]);
            }
            else {
-             mtest.deleteArr(idx);
+             mtest.deleteArr(idx, keep);
            }
          }
          else {
@@ -234,9 +531,8 @@ MTDeleteCmd::exec(const string& option)
              cerr << "Size of array list is 0!!" << endl;
            }
            else {
-             for (int i = 0; i < numOfRands; i++){
-               mtest.deleteArr(rnGen(mtest.getArrListSize()));
-             }
+             if (k) mtThreadsDeleteRandom(true, numOfRands, k);
+             else mtDeleteRandom(true, numOfRands);
            }
          }
          else {
@@ -258,7 +554,7 @@ MTDeleteCmd::exec(const string& option)
              CmdExec::errorOption(CMD_OPT_ILLEGAL, tokens[1]);
            }
            else {
-             mtest.deleteArr(idx);
+             mtest.deleteArr(idx, keep);
            }
          }
          else {
@@ -271,9 +567,8 @@ MTDeleteCmd::exec(const string& option)
              cerr << "Size of array list is 0!!" << endl;
            }
            else {
-             for (int i = 0; i < numOfRands; i++){
-               mtest.deleteArr(rnGen(mtest.getArrListSize()));
-             }
+             if (k) mtThreadsDeleteRandom(true, numOfRands, k);
+             else mtDeleteRandom(true, numOfRands);
            }
          }
          else {
@@ -297,8 +592,11 @@ MTDeleteCmd::exec(const string& option)
 void
 MTDeleteCmd::usage(ostream& os) const
 {
-   os << "Usage: MTDelete <-Index (size_t objId) | "
-      << "-Random (size_t numRandId)> [-Array]" << endl;
+   os << "Usage: MTDelete <-Index (size_t objId) [-Keep] | "
+      << "-Random (size_t numRandId) |" << endl
+      << "                 -Range (size_t from) (size_t to)> [-Array]"
+      << endl
+      << "                [-Threads (size_t k)]" << endl;
 }
 
 void
@@ -335,3 +633,448 @@ MTPrintCmd::help() const
    cout << setw(15) << left << "MTPrint: "
         << "(memory test) print memory manager info" << endl;
 }
+
+
+//----------------------------------------------------------------------
+//    MTMark
+//----------------------------------------------------------------------
+CmdExecStatus
+MTMarkCmd::exec(const string& option)
+{
+   // check option
+   if (option.size())
+      return CmdExec::errorOption(CMD_OPT_EXTRA, option);
+   if (!mtest.canMark()) {
+      cerr << "Cannot mark in shared, release or fit mode!!" << endl;
+      return CMD_EXEC_ERROR;
+   }
+   size_t m = mtest.mark();
+   cout << "Mark " << m << " (" << mtest.getObjListSize() << " objects, "
+        << mtest.getArrListSize() << " arrays)" << endl;
+
+   return CMD_EXEC_DONE;
+}
+
+void
+MTMarkCmd::usage(ostream& os) const
+{
+   os << "Usage: MTMark" << endl;
+}
+
+void
+MTMarkCmd::help() const
+{
+   cout << setw(15) << left << "MTMark: "
+        << "(memory test) mark the memory manager" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    MTRollback [(size_t mark)]
+//----------------------------------------------------------------------
+CmdExecStatus
+MTRollbackCmd::exec(const string& option)
+{
+   // check option
+   string token;
+   if (!CmdExec::lexSingleOption(option, token))
+      return CMD_EXEC_ERROR;
+   size_t n = mtest.getNumMarks();
+   if (n == 0) {
+      cerr << "No marks to roll back to!!" << endl;
+      return CMD_EXEC_ERROR;
+   }
+   // the last mark by default
+   int m = int(n) - 1;
+   if (token.size()) {
+      if (!myStr2Int(token, m) || m < 0 || size_t(m) >= n) {
+         cerr << "Illegal mark (" << token << ")!!" << endl;
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, token);
+      }
+   }
+   mtest.rollback(size_t(m));
+
+   return CMD_EXEC_DONE;
+}
+
+void
+MTRollbackCmd::usage(ostream& os) const
+{
+   os << "Usage: MTRollback [(size_t mark)]" << endl;
+}
+
+void
+MTRollbackCmd::help() const
+{
+   cout << setw(15) << left << "MTRollback: "
+        << "(memory test) free all allocated since a mark" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    MTStat [-Reset]
+//----------------------------------------------------------------------
+CmdExecStatus
+MTStatCmd::exec(const string& option)
+{
+   // check option
+   string token;
+   if (!CmdExec::lexSingleOption(option, token))
+      return CMD_EXEC_ERROR;
+   bool clear = false;
+   if (token.size()) {
+      if (myStrNCmp("-Reset", token, 2) == 0) clear = true;
+      else return CmdExec::errorOption(CMD_OPT_ILLEGAL, token);
+   }
+   mtest.printStats(clear);
+
+   return CMD_EXEC_DONE;
+}
+
+void
+MTStatCmd::usage(ostream& os) const
+{
+   os << "Usage: MTStat [-Reset]" << endl;
+}
+
+void
+MTStatCmd::help() const
+{
+   cout << setw(15) << left << "MTStat: "
+        << "(memory test) print allocation statistics" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    MTTrace <(string traceFile) | -Off>
+//----------------------------------------------------------------------
+CmdExecStatus
+MTTraceCmd::exec(const string& option)
+{
+   // check option
+   string token;
+   if (!CmdExec::lexSingleOption(option, token, false))
+      return CMD_EXEC_ERROR;
+   string name = mtest.getTraceName();
+   size_t numRecs = mtest.getTraceRecs();
+   bool ok = true;
+   if (myStrNCmp("-Off", token, 2) == 0) {
+      if (name.empty()) {
+         cerr << "Not tracing!!" << endl;
+         return CMD_EXEC_ERROR;
+      }
+      mtest.setTrace("");
+   }
+   else ok = mtest.setTrace(token);
+   // The last trace, if any, is closed either way
+   if (name.size())
+      cout << numRecs << " records traced to \"" << name << "\"" << endl;
+   if (!ok)
+      return CmdExec::errorOption(CMD_OPT_FOPEN_FAIL, token);
+
+   return CMD_EXEC_DONE;
+}
+
+void
+MTTraceCmd::usage(ostream& os) const
+{
+   os << "Usage: MTTrace <(string traceFile) | -Off>" << endl;
+}
+
+void
+MTTraceCmd::help() const
+{
+   cout << setw(15) << left << "MTTrace: "
+        << "(memory test) trace allocations to a file" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    MTLog [-On | -Off | -Clear | [(size_t last)] [-Event (string event)]...]
+//----------------------------------------------------------------------
+CmdExecStatus
+MTLogCmd::exec(const string& option)
+{
+   // check option
+   vector<string> options;
+   if (!CmdExec::lexOptions(option, options))
+      return CMD_EXEC_ERROR;
+   if (options.size() == 1) {
+      if (myStrNCmp("-On", options[0], 3) == 0) {
+         mtest.setLog(true);
+         return CMD_EXEC_DONE;
+      }
+      if (myStrNCmp("-Off", options[0], 3) == 0) {
+         mtest.setLog(false);
+         return CMD_EXEC_DONE;
+      }
+      if (myStrNCmp("-Clear", options[0], 2) == 0) {
+         mtest.clearLog();
+         return CMD_EXEC_DONE;
+      }
+   }
+   int last = 0;
+   bool hasLast = false;
+   uint32_t mask = 0;
+   for (size_t i = 0, n = options.size(); i < n; ++i) {
+      if (myStrNCmp("-Event", options[i], 2) == 0) {
+         if (i + 1 == n)
+            return CmdExec::errorOption(CMD_OPT_MISSING, options[i]);
+         size_t e = 0;
+         for (; e < MEM_LOG_TOT; ++e) {
+            const char* name = MemLog::getName(e);
+            if (myStrNCmp(name, options[i + 1], strlen(name)) == 0) break;
+         }
+         if (e == MEM_LOG_TOT)
+            return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[i + 1]);
+         mask |= uint32_t(1) << e;
+         ++i;
+      }
+      else if (hasLast)
+         return CmdExec::errorOption(CMD_OPT_EXTRA, options[i]);
+      else if (!myStr2Int(options[i], last) || last <= 0)
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[i]);
+      else hasLast = true;
+   }
+   if (!mtest.isLogOn())
+      cout << "(The log is off)" << endl;
+   size_t lost = mtest.printLog(size_t(last), mask? mask: ~uint32_t(0));
+   if (lost != 0 && !hasLast)
+      cout << "(" << lost << " older events overwritten)" << endl;
+
+   return CMD_EXEC_DONE;
+}
+
+void
+MTLogCmd::usage(ostream& os) const
+{
+   os << "Usage: MTLog [-On | -Off | -Clear | [(size_t last)] "
+      << "[-Event (string event)]...]" << endl;
+   os << "       event: ";
+   for (size_t e = 0; e < MEM_LOG_TOT; ++e)
+      os << (e? (e % 6? ", ": ",\n              "): "") << MemLog::getName(e);
+   os << endl;
+}
+
+void
+MTLogCmd::help() const
+{
+   cout << setw(15) << left << "MTLog: "
+        << "(memory test) print the allocation event log" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    MTBench <(size_t numObjects)> [-Array (size_t minSize) (size_t maxSize)]
+//            [-Delete (size_t percent)] [-Iter (size_t iterations)]
+//            [-Block (size_t blockSize)]
+//----------------------------------------------------------------------
+// Each iteration news 'numObjects' objects (arrays of [minSize, maxSize])
+// and then deletes 'percent' % of the live ones at random. Only the new
+// and delete calls are timed; the objects are kept in a local list, not
+// in mtest, which is reset beforehand (to set up the block size) and
+// left empty afterwards. The random numbers are seeded with MT_BENCH_SEED,
+// so a run can be repeated; they are drawn out of the timed calls.
+#define MT_BENCH_SEED 1
+
+typedef chrono::steady_clock  MTBenchClock;
+
+static double
+mtBenchNs(const MTBenchClock::time_point& t)
+{
+   return chrono::duration<double, nano>(MTBenchClock::now() - t).count();
+}
+
+static void
+mtBenchPercentiles(const char* op, vector<double>& ns)
+{
+   static const double pcts[] = { 50, 90, 99, 99.9 };
+   cout << "  " << setw(8) << left << op << right;
+   if (ns.empty()) { cout << " (none)" << endl; return; }
+   sort(ns.begin(), ns.end());
+   cout << fixed << setprecision(0);
+   for (size_t i = 0; i < sizeof(pcts) / sizeof(double); ++i) {
+      size_t k = size_t(pcts[i] / 100 * ns.size());
+      cout << setw(10) << ns[min(k, ns.size() - 1)];
+   }
+   cout << setw(12) << ns.back() << endl;
+   cout.unsetf(ios::floatfield);
+}
+
+CmdExecStatus
+MTBenchCmd::exec(const string& option)
+{
+   // check option
+   vector<string> options;
+   if (!CmdExec::lexOptions(option, options))
+      return CMD_EXEC_ERROR;
+   if (options.empty())
+      return CmdExec::errorOption(CMD_OPT_MISSING, "");
+   int numObj = -1, minSize = 0, maxSize = 0, pct = 50, iters = 1, b = 0;
+   bool doArr = false, hasDel = false, hasIter = false, hasBlock = false;
+   for (size_t i = 0, n = options.size(); i < n; ++i) {
+      if (myStrNCmp("-Array", options[i], 2) == 0) {
+         if (doArr) return CmdExec::errorOption(CMD_OPT_EXTRA, options[i]);
+         if (i + 2 >= n)
+            return CmdExec::errorOption(CMD_OPT_MISSING, options[i]);
+         if (!myStr2Int(options[++i], minSize) || minSize <= 0)
+            return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[i]);
+         if (!myStr2Int(options[++i], maxSize) || maxSize < minSize)
+            return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[i]);
+         doArr = true;
+         continue;
+      }
+      int* val = 0;
+      bool* has = 0;
+      if (myStrNCmp("-Delete", options[i], 2) == 0) {
+         val = &pct; has = &hasDel;
+      }
+      else if (myStrNCmp("-Iter", options[i], 2) == 0) {
+         val = &iters; has = &hasIter;
+      }
+      else if (myStrNCmp("-Block", options[i], 2) == 0) {
+         val = &b; has = &hasBlock;
+      }
+      if (has != 0) {
+         if (*has) return CmdExec::errorOption(CMD_OPT_EXTRA, options[i]);
+         if (i + 1 == n)
+            return CmdExec::errorOption(CMD_OPT_MISSING, options[i]);
+         *has = true;
+         if (!myStr2Int(options[++i], *val) || *val < 0 ||
+             (val == &pct && pct > 100) || (val == &iters && iters == 0) ||
+             (val == &b && b < int(toSizeT(sizeof(MemTestObj)))))
+            return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[i]);
+      }
+      else if (numObj >= 0)
+         return CmdExec::errorOption(CMD_OPT_EXTRA, options[i]);
+      else if (!myStr2Int(options[i], numObj) || numObj <= 0)
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[i]);
+   }
+   if (numObj < 0)
+      return CmdExec::errorOption(CMD_OPT_MISSING, "");
+
+   mtest.reset(toSizeT(size_t(b)));
+   mt19937 gen(MT_BENCH_SEED);
+   uniform_int_distribution<int> sizes(minSize, maxSize);
+   vector<MemTestObj*> live;
+   vector<double> newNs, delNs;
+   live.reserve(numObj);
+   newNs.reserve(size_t(numObj) * iters);
+   size_t maxBytes = 0;
+   double totalNs = 0;
+   bool oom = false;
+   try {
+      for (int r = 0; r < iters; ++r) {
+         for (int i = 0; i < numObj; ++i) {
+            MemTestObj* p = 0;
+            if (doArr) {
+               size_t s = size_t(sizes(gen));
+               MTBenchClock::time_point t = MTBenchClock::now();
+               p = new MemTestObj[s];
+               newNs.push_back(mtBenchNs(t));
+            }
+            else {
+               MTBenchClock::time_point t = MTBenchClock::now();
+               p = new MemTestObj;
+               newNs.push_back(mtBenchNs(t));
+            }
+            totalNs += newNs.back();
+            live.push_back(p);
+         }
+         maxBytes = max(maxBytes, mtest.getFootprint());
+         for (size_t k = live.size() * pct / 100; k > 0; --k) {
+            size_t j = gen() % live.size();
+            MemTestObj* p = live[j];
+            live[j] = live.back();
+            live.pop_back();
+            MTBenchClock::time_point t = MTBenchClock::now();
+            if (doArr) delete []p;
+            else delete p;
+            delNs.push_back(mtBenchNs(t));
+            totalNs += delNs.back();
+         }
+      }
+   }
+   catch (bad_alloc&) {
+      cerr << "Out of memory after " << newNs.size() << " allocations!!"
+           << endl;
+      oom = true;
+   }
+   size_t numLive = live.size(), liveBytes = mtest.getFootprint();
+   for (size_t i = 0; i < numLive; ++i)
+      if (doArr) delete []live[i];
+      else delete live[i];
+   if (oom) return CMD_EXEC_ERROR;
+   size_t numOps = newNs.size() + delNs.size();
+   double mops = (totalNs > 0)? numOps * 1e3 / totalNs: 0;
+
+   cout << "MTBench: " << iters << " x " << numObj
+        << (doArr? " arrays, ": " objects, ") << pct << "% deleted" << endl
+        << "  new " << newNs.size() << ", delete " << delNs.size()
+        << " in " << fixed << setprecision(3) << totalNs / 1e6 << " ms ("
+        << setprecision(2) << mops << " Mops/s)" << endl;
+   cout.unsetf(ios::floatfield);
+   cout << "  (ns)         p50       p90       p99     p99.9         max"
+        << endl;
+   mtBenchPercentiles("new", newNs);
+   mtBenchPercentiles("delete", delNs);
+   cout << "  memory: " << numLive << " live, " << liveBytes
+        << " Bytes (peak " << maxBytes << ")" << endl;
+
+   return CMD_EXEC_DONE;
+}
+
+void
+MTBenchCmd::usage(ostream& os) const
+{
+   os << "Usage: MTBench <(size_t numObjects)> "
+      << "[-Array (size_t minSize) (size_t maxSize)]" << endl
+      << "               [-Delete (size_t percent)] "
+      << "[-Iter (size_t iterations)]" << endl
+      << "               [-Block (size_t blockSize)]" << endl
+      << "  (resets mtest first; the benchmark objects are deleted at the end)"
+      << endl;
+}
+
+void
+MTBenchCmd::help() const
+{
+   cout << setw(15) << left << "MTBench: "
+        << "(memory test) time a random new/delete workload" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    MTUsage [-Clock | -Rss]
+//----------------------------------------------------------------------
+CmdExecStatus
+MTUsageCmd::exec(const string& option)
+{
+   // check option
+   string token;
+   if (!CmdExec::lexSingleOption(option, token))
+      return CMD_EXEC_ERROR;
+   bool doClock = true, doRss = true;
+   if (token.size()) {
+      if (myStrNCmp("-Clock", token, 2) == 0) doRss = false;
+      else if (myStrNCmp("-Rss", token, 2) == 0) doClock = false;
+      else return CmdExec::errorOption(CMD_OPT_ILLEGAL, token);
+   }
+   if (doClock) myUsage.reportClocks();
+   if (doRss) myUsage.reportRss(mtest.getFootprint());
+
+   return CMD_EXEC_DONE;
+}
+
+void
+MTUsageCmd::usage(ostream& os) const
+{
+   os << "Usage: MTUsage [-Clock | -Rss]" << endl;
+}
+
+void
+MTUsageCmd::help() const
+{
+   cout << setw(15) << left << "MTUsage: "
+        << "(memory test) report clocks, RSS and page faults" << endl;
+}
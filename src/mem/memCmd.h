@@ -14,5 +14,12 @@ CmdClass(MTResetCmd);
 CmdClass(MTNewCmd);
 CmdClass(MTDeleteCmd);
 CmdClass(MTPrintCmd);
+CmdClass(MTMarkCmd);
+CmdClass(MTRollbackCmd);
+CmdClass(MTStatCmd);
+CmdClass(MTTraceCmd);
+CmdClass(MTLogCmd);
+CmdClass(MTBenchCmd);
+CmdClass(MTUsageCmd);
 
 #endif // MEM_CMD_H
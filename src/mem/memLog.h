@@ -0,0 +1,187 @@
+/****************************************************************************
+  FileName     [ memLog.h ]
+  PackageName  [ mem ]
+  Synopsis     [ Define the in-memory event log of MemMgr ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+
+#ifndef MEM_LOG_H
+#define MEM_LOG_H
+
+#include <iostream>
+#include <atomic>
+#include <stdint.h>
+
+using namespace std;
+
+//--------------------------------------------------------------------------
+// Event log
+//--------------------------------------------------------------------------
+// A ring of the last MEM_LOG_SIZE (a power of 2) events of the memory
+// managers, kept as binary records and printed only on demand, in the
+// text MEM_DEBUG builds used to print on each call (see MTLog).
+#define MEM_LOG_SIZE (size_t(1) << 16)
+
+// What is printed for each event; 'p' is the address, 'n' the number
+enum MemLogEvent
+{
+   MEM_LOG_ALLOC          =  0,  // Calling alloc...(n)
+   MEM_LOG_ALLOC_ARR      =  1,  // Calling allocArr...(n)
+   MEM_LOG_GET_MEM        =  2,  // Calling MemMgr::getMem...(n)
+   MEM_LOG_ACQUIRED       =  3,  // Memory acquired... p
+   MEM_LOG_RECYCLED       =  4,  // Recycled from _recycleList[n]...p
+   MEM_LOG_RECYCLING      =  5,  // Recycling p to _recycleList[n]
+   MEM_LOG_NEW_BLOCK      =  6,  // New MemBlock... p
+   MEM_LOG_FREE           =  7,  // Calling free...(p)
+   MEM_LOG_FREE_ARR       =  8,  // Calling freeArr...(p)
+   MEM_LOG_ARR_SIZE       =  9,  // >> Array size = n
+   MEM_LOG_RESET          = 10,  // Resetting memMgr...(n)
+   MEM_LOG_MARK           = 11,  // Marking memMgr...(n)
+   MEM_LOG_ROLLBACK       = 12,  // Rolling back memMgr...(n)
+   MEM_LOG_SPLIT          = 13,  // Split from _recycleList[n]...p
+   MEM_LOG_COALESCE       = 14,  // Coalescing recycle lists... n merges
+                                 // (p Bytes)
+   MEM_LOG_RELEASE_BLOCK  = 15,  // Releasing MemBlock... p
+   MEM_LOG_NEW_SPAN       = 16,  // New large span... p (n)
+   MEM_LOG_RELEASE_SPAN   = 17,  // Releasing large span... p
+   MEM_LOG_THREAD_RECYCLED = 18, // Recycled from thread _recycleList[n]...p
+   MEM_LOG_THREAD_BLOCK   = 19,  // New thread MemBlock... p
+
+   // dummy
+   MEM_LOG_TOT
+};
+
+struct MemLogRec
+{
+   uint64_t  _p;
+   uint64_t  _word;       // n << 8 | MemLogEvent
+};
+
+// put() is lock-free: a writer claims a record with one atomic increment
+// and fills it with two stores. A record being written while the log is
+// printed may come out half old; print it when the managers are idle.
+//
+class MemLog
+{
+public:
+   MemLog() : _on(false), _head(0) {}
+
+   void setOn(bool o) { _on = o; }
+   bool isOn() const { return _on.load(memory_order_relaxed); }
+   void clear() { _head = 0; }
+   // #events put since the last clear(), and those still in the ring
+   size_t getNumPut() const { return _head; }
+   size_t getNumKept() const {
+      size_t h = _head;
+      return (h < MEM_LOG_SIZE)? h: MEM_LOG_SIZE;
+   }
+
+   void put(MemLogEvent e, size_t p, size_t n = 0) {
+      MemLogRec& r =
+         _ring[_head.fetch_add(1, memory_order_relaxed) & (MEM_LOG_SIZE - 1)];
+      r._p = p;
+      r._word = (uint64_t(n) << 8) | e;
+   }
+
+   // Print the last 'last' (0: all) kept events of the events in 'mask'
+   // (bit e for event e), oldest first
+   void print(ostream& os, size_t last = 0, uint32_t mask = ~uint32_t(0))
+   const {
+      size_t h = _head, k = getNumKept();
+      if (last != 0 && last < k) k = last;
+      for (size_t i = h - k; i != h; ++i) {
+         const MemLogRec& r = _ring[i & (MEM_LOG_SIZE - 1)];
+         if ((mask >> (r._word & 0xff)) & 1) printRec(os, r);
+      }
+      os.flush();
+   }
+   // Print all the kept events and clear the log (MEM_DEBUG builds)
+   void drain(ostream& os) {
+      if (_head == 0) return;
+      print(os);
+      clear();
+   }
+
+   // The name of event 'e' for MTLog -Event, e.g. "AllocArr" for
+   // MEM_LOG_ALLOC_ARR
+   static const char* getName(size_t e) {
+      static const char* names[MEM_LOG_TOT] = {
+         "Alloc", "AllocArr", "GetMem", "Acquired", "Recycled",
+         "Recycling", "NewBlock", "Free", "FreeArr", "ArrSize", "Reset",
+         "Mark", "Rollback", "Split", "Coalesce", "ReleaseBlock",
+         "NewSpan", "ReleaseSpan", "ThreadRecycled", "ThreadBlock"
+      };
+      return (e < MEM_LOG_TOT)? names[e]: "";
+   }
+
+private:
+   static void printRec(ostream& os, const MemLogRec& r) {
+      const void* p = (const void*)size_t(r._p);
+      size_t n = size_t(r._word >> 8);
+      switch (r._word & 0xff) {
+         case MEM_LOG_ALLOC:
+            os << "Calling alloc...(" << n << ")\n"; break;
+         case MEM_LOG_ALLOC_ARR:
+            os << "Calling allocArr...(" << n << ")\n"; break;
+         case MEM_LOG_GET_MEM:
+            os << "Calling MemMgr::getMem...(" << n << ")\n"; break;
+         case MEM_LOG_ACQUIRED:
+            os << "Memory acquired... " << p << "\n"; break;
+         case MEM_LOG_RECYCLED:
+            os << "Recycled from _recycleList[" << n << "]..." << p << "\n";
+            break;
+         case MEM_LOG_RECYCLING:
+            os << "Recycling " << p << " to _recycleList[" << n << "]\n";
+            break;
+         case MEM_LOG_NEW_BLOCK:
+            os << "New MemBlock... " << p << "\n"; break;
+         case MEM_LOG_FREE:
+            os << "Calling free...(" << p << ")\n"; break;
+         case MEM_LOG_FREE_ARR:
+            os << "Calling freeArr...(" << p << ")\n"; break;
+         case MEM_LOG_ARR_SIZE:
+            os << ">> Array size = " << n << "\n"; break;
+         case MEM_LOG_RESET:
+            os << "Resetting memMgr...(" << n << ")\n"; break;
+         case MEM_LOG_MARK:
+            os << "Marking memMgr...(" << n << ")\n"; break;
+         case MEM_LOG_ROLLBACK:
+            os << "Rolling back memMgr...(" << n << ")\n"; break;
+         case MEM_LOG_SPLIT:
+            os << "Split from _recycleList[" << n << "]..." << p << "\n";
+            break;
+         case MEM_LOG_COALESCE:
+            os << "Coalescing recycle lists... " << n << " merges ("
+               << size_t(r._p) << " Bytes)\n";
+            break;
+         case MEM_LOG_RELEASE_BLOCK:
+            os << "Releasing MemBlock... " << p << "\n"; break;
+         case MEM_LOG_NEW_SPAN:
+            os << "New large span... " << p << " (" << n << ")\n"; break;
+         case MEM_LOG_RELEASE_SPAN:
+            os << "Releasing large span... " << p << "\n"; break;
+         case MEM_LOG_THREAD_RECYCLED:
+            os << "Recycled from thread _recycleList[" << n << "]..." << p
+               << "\n";
+            break;
+         case MEM_LOG_THREAD_BLOCK:
+            os << "New thread MemBlock... " << p << "\n"; break;
+         default:
+            os << "(bad record " << (r._word & 0xff) << ")\n"; break;
+      }
+   }
+
+   atomic<bool>         _on;
+   atomic<size_t>       _head;         // #events put; the next one
+   MemLogRec            _ring[MEM_LOG_SIZE];
+};
+
+// The log of all the memory managers
+inline MemLog& memLog()
+{
+   static MemLog log;
+   return log;
+}
+
+#endif // MEM_LOG_H
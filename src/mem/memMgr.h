@@ -12,7 +12,17 @@
 #include <cassert>
 #include <iostream>
 #include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <chrono>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "memTrace.h"
+#include "memLog.h"
 
 using namespace std;
 
@@ -22,19 +32,53 @@ using namespace std;
 //--------------------------------------------------------------------------
 // Define MACROs
 //--------------------------------------------------------------------------
-#define MEM_MGR_INIT(T) \
-MemMgr<T>* const T::_memMgr = new MemMgr<T>
+#define MEM_MGR_INIT(T) MEM_MGR_INIT_AS(T, MemMgr<T>)
+#define USE_MEM_MGR(T)  USE_MEM_MGR_AS(T, MemMgr<T>)
 
-#define USE_MEM_MGR(T)                                                      \
+// The same, with any MemMgr<T, BlockSize, Policies...> as the manager
+#define MEM_MGR_INIT_AS(T, ...) \
+__VA_ARGS__* const T::_memMgr = new __VA_ARGS__
+
+#define USE_MEM_MGR_AS(T, ...)                                              \
 public:                                                                     \
    void* operator new(size_t t) { return (void*)(_memMgr->alloc(t)); }      \
    void* operator new[](size_t t) { return (void*)(_memMgr->allocArr(t)); } \
    void  operator delete(void* p) { _memMgr->free((T*)p); }                 \
    void  operator delete[](void* p) { _memMgr->freeArr((T*)p); }            \
+   void* operator new(size_t, void* p) { return p; }                        \
+   void  operator delete(void*, void*) {}                                   \
+   static void memAllocBatch(size_t n, T** p) { _memMgr->allocBatch(n, p); }\
+   static void memFreeBatch(size_t n, T** p) { _memMgr->freeBatch(n, p); }  \
+   static void memFreeArrBatch(size_t n, T** p)                             \
+      { _memMgr->freeArrBatch(n, p); }                                      \
    static void memReset(size_t b = 0) { _memMgr->reset(b); }                \
    static void memPrint() { _memMgr->print(); }                             \
+   static void memSetThreadMode(MemThreadMode m)                            \
+      { _memMgr->setThreadMode(m); }                                        \
+   static MemThreadMode memGetThreadMode()                                  \
+      { return _memMgr->getThreadMode(); }                                  \
+   static void memSetLargeObj(bool l) { _memMgr->setLargeObj(l); }          \
+   static void memSetReleaseEmpty(bool r) { _memMgr->setReleaseEmpty(r); }  \
+   static size_t memReleaseEmpty() { return _memMgr->releaseEmptyBlocks(); }\
+   static void memSetFit(bool f) { _memMgr->setFit(f); }                    \
+   static size_t memCoalesce() { return _memMgr->coalesce(); }              \
+   static void memSetStore(MemStore s) { _memMgr->setStore(s); }            \
+   static void memSetAlign(size_t a) { _memMgr->setAlign(a); }              \
+   static void memSetNoStraddle(bool s) { _memMgr->setNoStraddle(s); }      \
+   static void memSetShared(bool s) { _memMgr->setShared(s); }              \
+   static void memSetHardened(bool h) { _memMgr->setHardened(h); }          \
+   static bool memGetHardened() { return _memMgr->getHardened(); }          \
+   static bool memIsShared() { return _memMgr->getShared(); }               \
+   static size_t memMark() { return _memMgr->mark(); }                      \
+   static void memRollback(size_t m) { _memMgr->rollback(m); }              \
+   static bool memCanMark() { return _memMgr->canMark(); }                  \
+   static void memPrintStats() { _memMgr->printStats(); }                   \
+   static void memClearStats() { _memMgr->clearStats(); }                   \
+   static bool memSetTrace(const string& f) { return _memMgr->setTrace(f); }\
+   static const MemTracer* memGetTrace() { return _memMgr->getTrace(); }    \
+   static size_t memFootprint() { return _memMgr->getFootprint(); }         \
 private:                                                                    \
-   static MemMgr<T>* const _memMgr
+   static __VA_ARGS__* const _memMgr
 
 // You should use the following two MACROs whenever possible to
 // make your code 64/32-bit platform independent.
@@ -47,19 +91,196 @@ private:                                                                    \
 //
 // To promote 't' to the nearest multiple of SIZE_T;
 // e.g. Let SIZE_T = 8;  toSizeT(7) = 8, toSizeT(12) = 16
-#define toSizeT(t)      (t%SIZE_T == 0? t : ((t/SIZE_T) + 1) * SIZE_T)  // TODO
+#define toSizeT(t)      ((t) % SIZE_T == 0? (t) : ((t) / SIZE_T + 1) * SIZE_T)
 //
 // To demote 't' to the nearest multiple of SIZE_T
 // e.g. Let SIZE_T = 8;  downtoSizeT(9) = 8, downtoSizeT(100) = 96
-#define downtoSizeT(t)  (t%SIZE_T == 0? t : ((t/SIZE_T) * SIZE_T))  // TODO
+#define downtoSizeT(t)  ((t) % SIZE_T == 0? (t) : (t) / SIZE_T * SIZE_T)
 
 // R_SIZE is the size of the recycle list
 #define R_SIZE 256
 
+// Array sizes [R_SIZE, R_FLAT) that fit in a block have a recycle list
+// each, indexed directly. Bigger arrays are rounded to geometric classes
+// of R_STEP lists per power of 2 (R_FLAT must be a power of 2).
+#define R_FLAT 4096
+#define R_STEP 4
+
+// In MEM_THREAD_CACHE mode --
+// TC_SIZE : arrays of size [0, TC_SIZE) are recycled by the thread caches;
+//           bigger ones go to the central _recycleList[] under the lock
+// TC_BATCH: #elements moved between a thread cache and the central
+//           _recycleList[] in one refill or flush
+#define TC_SIZE  16
+#define TC_BATCH 32
+
+// With empty-block release on --
+// MEM_RELEASE_BATCH: #blocks found empty by free() to trigger a release
+// MEM_SPARE_MAX    : #released blocks kept for reuse instead of deleted
+#define MEM_RELEASE_BATCH 4
+#define MEM_SPARE_MAX     4
+
+// With fit on, the #chunks the automatic coalesce sorts at most in a call
+// (see setFit())
+#define MEM_COALESCE_BATCH 4096
+
+// The (transparent) huge page size for MEM_STORE_HUGE
+#define MEM_HUGE_PAGE (size_t(1) << 21)
+
+// The cache line size objects must not straddle (see setNoStraddle())
+#define MEM_LINE 64
+
+//--------------------------------------------------------------------------
+// Thread modes
+//--------------------------------------------------------------------------
+// MEM_THREAD_NONE : single-threaded; nothing is synchronized (default)
+// MEM_THREAD_CACHE: each thread bumps from its own MemBlock and recycles
+//                   small arrays in its own lists. Only block switches and
+//                   batch refills/flushes lock the central manager.
+enum MemThreadMode
+{
+   MEM_THREAD_NONE  = 0,
+   MEM_THREAD_CACHE = 1,
+
+   // dummy
+   MEM_THREAD_TOT
+};
+
+//--------------------------------------------------------------------------
+// Block stores
+//--------------------------------------------------------------------------
+// MEM_STORE_NEW : new[] (default); aligned blocks are mapped as with
+//                 MEM_STORE_MMAP, as posix_memalign() would take twice
+//                 their window, its slack being of no use to malloc()
+// MEM_STORE_MMAP: anonymous mmap()
+// MEM_STORE_HUGE: anonymous mmap() of whole huge pages, advised with
+//                 madvise(MADV_HUGEPAGE). Falls back to MEM_STORE_MMAP for
+//                 blocks smaller than MEM_HUGE_PAGE, or if the system does
+//                 not support it.
+enum MemStore
+{
+   MEM_STORE_NEW  = 0,
+   MEM_STORE_MMAP = 1,
+   MEM_STORE_HUGE = 2,
+
+   // dummy
+   MEM_STORE_TOT
+};
+
+//--------------------------------------------------------------------------
+// Raw storage
+//--------------------------------------------------------------------------
+// 'N' Bytes aligned to 'A'; what a MemMgr pools for types it does not
+// know (see setShared() and memAlloc.h).
+// The destructor only makes new[] keep the array size, as MemMgr wants.
+template <size_t N, size_t A>
+struct MemRaw
+{
+   ~MemRaw() {}
+   alignas(A) char  _d[N];
+};
+
+// The raw storage shared by T and every other type of the same size and
+// alignment, both rounded up to SIZE_T
+template <class T>
+struct MemRawOf
+{
+   typedef MemRaw<toSizeT(sizeof(T)),
+                  (alignof(T) > SIZE_T? alignof(T): SIZE_T)>  Type;
+};
+
+//--------------------------------------------------------------------------
+// MemMgr policies
+//--------------------------------------------------------------------------
+// MemMgr<T, BlockSize, Policies...> fixes at compile time what its
+// parameters name, so that the hot path folds to a few instructions; the
+// rest can still be set at run time as with MemMgr<T>.
+// BlockSize: the block size; 0 (default) for the one given to reset(b)
+// Policies, in any order --
+// MemClasses<Size, Flat, Step>: the size-class layout; R_SIZE, R_FLAT
+//                               and R_STEP by default (Size >= TC_SIZE)
+// MemThreads<M>               : the thread mode; setThreadMode() can no
+//                               longer change it
+// MemStats<false>             : drop the live-Byte counts and the MemStat
+//                               counters kept on every alloc and free
+//                               (getLiveBytes() is 0)
+template <size_t N, size_t F, size_t P>
+struct MemClasses
+{
+   static_assert(F >= N && (F & (F - 1)) == 0, "bad flat class range");
+   static_assert(P != 0 && (P & (P - 1)) == 0 && P <= F, "bad class step");
+   // (the thread caches share _recycleList[0, TC_SIZE) with MemMgr)
+   static_assert(N >= TC_SIZE, "fewer recycle lists than TC_SIZE");
+   static constexpr size_t size = N;
+   static constexpr size_t flat = F;
+   static constexpr size_t step = P;
+};
+
+template <MemThreadMode M> struct MemThreads {};
+template <bool B> struct MemStats {};
+
+// Resolve Policies... into Classes, fixedThread, thread and stats
+template <class... P>
+struct MemPolicy
+{
+   typedef MemClasses<R_SIZE, R_FLAT, R_STEP> Classes;
+   static constexpr bool fixedThread = false;
+   static constexpr MemThreadMode thread = MEM_THREAD_NONE;
+   static constexpr bool stats = true;
+};
+
+template <size_t N, size_t F, size_t P, class... R>
+struct MemPolicy<MemClasses<N, F, P>, R...> : public MemPolicy<R...>
+{
+   typedef MemClasses<N, F, P> Classes;
+};
+
+template <MemThreadMode M, class... R>
+struct MemPolicy<MemThreads<M>, R...> : public MemPolicy<R...>
+{
+   static constexpr bool fixedThread = true;
+   static constexpr MemThreadMode thread = M;
+};
+
+template <bool B, class... R>
+struct MemPolicy<MemStats<B>, R...> : public MemPolicy<R...>
+{
+   static constexpr bool stats = B;
+};
+
+//--------------------------------------------------------------------------
+// Statistics
+//--------------------------------------------------------------------------
+// Counters of a MemMgr since the last reset() or clearStats(); kept in
+// MEM_THREAD_NONE mode, unless MemStats<false>
+struct MemStat
+{
+   MemStat() { clear(); }
+   void clear() {
+      _numAlloc = _numHit = _numBump = _numSplit = _numLarge = 0;
+      _numFree = _numLargeFree = _numSwitch = _tailBytes = _tailWaste = 0;
+   }
+
+   size_t  _numAlloc;      // objects and arrays
+   size_t  _numHit;        // popped from a recycle list
+   size_t  _numBump;       // carved from the active block
+   size_t  _numSplit;      // split from a bigger chunk (see setFit())
+   size_t  _numLarge;      // mapped as large spans
+   size_t  _numFree;       // including the large ones
+   size_t  _numLargeFree;
+   size_t  _numSwitch;     // block switches
+   size_t  _tailBytes;     // #Bytes of the block tails recycled at them
+   size_t  _tailWaste;     // #Bytes of the tails too small to recycle
+};
+
 //--------------------------------------------------------------------------
 // Forward declarations
 //--------------------------------------------------------------------------
-template <class T> class MemMgr;
+template <class T, size_t BlockSize = 0, class... Policies> class MemMgr;
+template <class R> MemMgr<R>* memArena();
+template <class T> class MemMgrBase;
+template <class T> class MemThreadCache;
+template <class T> class MemThreadCacheList;
 
 
 //--------------------------------------------------------------------------
@@ -73,60 +294,172 @@ template <class T> class MemMgr;
 template <class T>
 class MemBlock
 {
-   friend class MemMgr<T>;
+   template <class U, size_t B, class... P> friend class MemMgr;
 
    // Constructor/Destructor
-   MemBlock(MemBlock<T>* n, size_t b) : _nextBlock(n) {
-      _begin = _ptr = new char[b]; _end = _begin + b; }
-   ~MemBlock() { delete [] _begin; }
-
-   // Member functions
-   void reset() { _ptr = _begin; }
-   // 1. Get (at least) 't' bytes memory from current block
-   //    Promote 't' to a multiple of SIZE_T
-   // 2. Update "_ptr" accordingly
-   // 3. The return memory address is stored in "ret"
-   // 4. Return false if not enough memory
-   bool getMem(size_t t, T*& ret) {
-      // TODO
-      toSizeT(t);
-      if (t > _end - _ptr){
-        return false;
-      }
+   // The MemBlock is the header of its own storage, with the 'b' Bytes of
+   // the objects hdrSize() after it (after the free map, if 'fm'); a
+   // block is one system allocation. Use create() and destroy().
+   MemBlock(MemBlock<T>* n, size_t b, size_t a, MemStore s, bool fm)
+   : _nextBlock(n), _owner(0), _align(a), _store(s), _fallback(false),
+     _mapBytes(0), _numLive(0), _liveBytes(0), _maxBytes(0), _empty(false),
+     _freeMap(0) {
+      _begin = (char*)this + hdrSize();
+      if (fm) { _freeMap = _begin; _begin += freeMapBytes(b); }
+      _ptr = _begin; _end = _begin + b;
+   }
+   ~MemBlock() {}
 
-      ret = _ptr;
-      _ptr += t;
+   // Create a block of 'b' Bytes in front of 'n'
+   // a == 0: unaligned storage
+   // a != 0: storage aligned to 'a' (a power of 2 >= b + hdrSize(), with
+   //         the free map), so that any address in the block finds it
+   //         with getBlock(); always mapped
+   // s     : where the storage comes from
+   // fm    : with a free map (hardened mode)
+   static MemBlock<T>* create(MemBlock<T>* n, size_t b, size_t a = 0,
+                              MemStore s = MEM_STORE_NEW, bool fm = false) {
+      size_t t = b + hdrSize() + (fm? freeMapBytes(b): 0);
+      assert(a == 0 || t <= a);
+      char* base = 0;
+      size_t mapBytes = 0;
+      bool fallback = false;
+      if (s != MEM_STORE_NEW || a != 0)
+         base = mapStore(t, a, s, mapBytes, fallback);
+      else
+         base = (char*)::operator new(t);
+      MemBlock<T>* blk = new (base) MemBlock<T>(n, b, a, s, fm);
+      blk->_mapBytes = mapBytes;
+      blk->_fallback = fallback;
+      if (fm) blk->clearFreeMap();
+      return blk;
+   }
+   static void destroy(MemBlock<T>* blk) {
+      if (blk == 0) return;
+      size_t mapBytes = blk->_mapBytes;
+      blk->~MemBlock();
+      if (mapBytes != 0) munmap(blk, mapBytes);
+      else ::operator delete(blk);
+   }
+   // #Bytes in front of _begin, kept to 16 for the objects' alignment
+   static size_t hdrSize() {
+      return (sizeof(MemBlock<T>) + 15) & ~size_t(15); }
+   // #Bytes of the free map of a block of 'b' Bytes: a Byte per
+   // 2 * SIZE_T of its storage, the header and the map included
+   static size_t freeMapBytes(size_t b) {
+      size_t m = (hdrSize() + b + 2 * SIZE_T - 2) / (2 * SIZE_T - 1);
+      return toSizeT(m);
+   }
 
-      return true;
+   // Member functions
+   void reset() {
+      _ptr = _begin; _numLive = _liveBytes = _maxBytes = 0; _empty = false;
+      if (_freeMap != 0) clearFreeMap();
+   }
+   // The free map (hardened mode) of the block of 'p', aligned to 'a',
+   // has the Byte of 'p' set if the chunk is in a recycle list. It is
+   // found at a fixed offset, without reading the header. A chunk has
+   // 2 * SIZE_T Bytes at least in hardened mode, so has a Byte of its
+   // own; unlike bits, the Bytes of adjacent chunks are written apart.
+   // Set the Byte of 'p' to 'f' and return what it was.
+   static bool setFree(const void* p, size_t a, bool f) {
+      char* m = getFreeByte(p, a);
+      bool old = *m;
+      *m = f;
+      return old;
+   }
+   // Whether the Byte of 'p' is set
+   static bool isFree(const void* p, size_t a) { return *getFreeByte(p, a); }
+   static char* getFreeByte(const void* p, size_t a) {
+      size_t i = (size_t(p) & (a - 1)) / (2 * SIZE_T);
+      return (char*)getBlock(p, a) + hdrSize() + i;
+   }
+   void clearFreeMap() { memset(_freeMap, 0, freeMapBytes(getSize())); }
+   size_t getSize() const { return size_t(_end - _begin); }
+   // #Bytes taken from the store: the header, free map and storage, as
+   // mapped (in whole pages)
+   size_t getStoreBytes() const {
+      return (_mapBytes != 0)? _mapBytes: size_t(_end - (char*)this); }
+   // Count 'k' objects of 't' Bytes in, or one out of, this block
+   void addLive(size_t t, size_t k = 1) {
+      _numLive += k;
+      if ((_liveBytes += k * t) > _maxBytes) _maxBytes = _liveBytes;
    }
+   void removeLive(size_t t) {
+      assert(_numLive != 0 && _liveBytes >= t);
+      --_numLive; _liveBytes -= t;
+   }
+   // Find the block containing 'p' among the blocks aligned to 'a'
+   static MemBlock<T>* getBlock(const void* p, size_t a) {
+      return (MemBlock<T>*)(size_t(p) & ~(a - 1)); }
    size_t getRemainSize() const { return size_t(_end - _ptr); }
 
    MemBlock<T>* getNextBlock() const { return _nextBlock; }
 
+   // Map 't' Bytes aligned to 'a' (0: to a page) from the store 's';
+   // 'len' is the #Bytes mapped, and 'fallback' if not on huge pages
+   static char* mapStore(size_t t, size_t a, MemStore s, size_t& len,
+                         bool& fallback) {
+      size_t page = sysconf(_SC_PAGESIZE);
+      size_t unit = page;
+      #ifdef MADV_HUGEPAGE
+      if (s == MEM_STORE_HUGE && t >= MEM_HUGE_PAGE) unit = MEM_HUGE_PAGE;
+      #endif // MADV_HUGEPAGE
+      if (s == MEM_STORE_HUGE && unit == page) fallback = true;
+      size_t al = (a > unit)? a: unit;
+      len = (t + unit - 1) / unit * unit;
+      // Map 'al - page' more to align it, and unmap the ends
+      size_t over = len + al - page;
+      char* m = (char*)mmap(0, over, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANON, -1, 0);
+      if (m == (char*)MAP_FAILED) throw bad_alloc();
+      char* base = (char*)((size_t(m) + al - 1) & ~(al - 1));
+      if (base != m) munmap(m, base - m);
+      if (base + len != m + over) munmap(base + len, m + over - base - len);
+      #ifdef MADV_HUGEPAGE
+      if (unit != page && madvise(base, len, MADV_HUGEPAGE) != 0)
+         fallback = true;
+      #endif // MADV_HUGEPAGE
+      return base;
+   }
+
    // Data members
-   char*             _begin;
-   char*             _ptr;
-   char*             _end;
-   MemBlock<T>*      _nextBlock;
+   char*               _begin;
+   char*               _ptr;
+   char*               _end;
+   MemBlock<T>*        _nextBlock;
+   MemThreadCache<T>*  _owner;     // the cache bumping from this block;
+                                   // 0 for the central blocks
+   size_t              _align;
+   MemStore            _store;
+   bool                _fallback;  // MEM_STORE_HUGE but on plain pages
+   size_t              _mapBytes;  // #Bytes mapped; 0 if not mapped
+   // Counted only if MemMgr can find the block of an object (isCounted())
+   size_t              _numLive;   // #objects in use
+   size_t              _liveBytes; // #Bytes in use
+   size_t              _maxBytes;  // high-water mark of _liveBytes
+   bool                _empty;     // to be released
+   char*               _freeMap;   // at _begin - freeMapBytes() in
+                                   // hardened mode; else 0
 };
 
 // Make it a private class;
-// Only friend to MemMgr;
+// Only friend to MemMgr (and MemThreadCache);
 //
 template <class T>
 class MemRecycleList
 {
-   friend class MemMgr<T>;
+   template <class U, size_t B, class... P> friend class MemMgr;
+   friend class MemThreadCache<T>;
 
    // Constructor/Destructor
-   MemRecycleList(size_t a = 0) : _arrSize(a), _first(0), _nextList(0) {}
+   MemRecycleList(size_t a = 0)
+   : _arrSize(a), _first(0), _numElm(0), _maxElm(0), _key(0), _link(0) {}
    ~MemRecycleList() { reset(); }
 
    // Member functions
    // ----------------
    size_t getArrSize() const { return _arrSize; }
-   MemRecycleList<T>* getNextList() const { return _nextList; }
-   void setNextList(MemRecycleList<T>* l) { _nextList = l; }
    // pop out the first element in the recycle list
    T* popFront() {
       // TODO
@@ -135,81 +468,580 @@ class MemRecycleList
       }
 
       T* returnValue = _first;
-      _first = (T*)(*((size_t*)_first));
+      _first = getNext(_first);
+      --_numElm;
       return returnValue;
    }
    // push the element 'p' to the beginning of the recycle list
    void  pushFront(T* p) {
       // TODO
       T* newFirst = p;
-      *((size_t*)p) = (size_t)_first;
+      setNext(p, _first);
       _first = newFirst;
+      if (++_numElm > _maxElm) _maxElm = _numElm;
    }
-   // Release the memory occupied by the recycle list(s)
-   // DO NOT release the memory occupied by MemMgr/MemBlock
-   void reset() {
-      // TODO
-      /*if (_nextList == 0){
-        _first = 0;
-        return;
-      }
-      else {
-        _nextList->reset();
+   // move (at most) 'k' elements from the front of 'l' to the front
+   // of this list; return the number of elements moved
+   size_t takeFront(MemRecycleList<T>* l, size_t k) {
+      assert(_key == 0 && l->_key == 0);
+      if (l->_first == 0 || k == 0) return 0;
+      T* first = l->_first;
+      T* last = first;
+      size_t count = 1;
+      for (T* p = getNext(last); p != 0 && count < k; p = getNext(p)) {
+         last = p; ++count;
       }
-      _first = 0;*/
-      /*if (_nextList != 0){
-        _first = 0;
-        delete _nextList;
-      }*/
-      if (_nextList != 0){
-        _first = 0;
-        _nextList->reset();
-        delete _nextList;
-        _nextList = 0;
-      }
-      _first = 0;
+      l->_first = getNext(last);
+      *((size_t*)last) = (size_t)_first;
+      _first = first;
+      // ('l' may be a bare chain that was never counted)
+      l->_numElm = (l->_numElm > count)? l->_numElm - count: 0;
+      if ((_numElm += count) > _maxElm) _maxElm = _numElm;
+      return count;
+   }
+   // push the 'k' elements already linked from 'first' to 'last' to the
+   // beginning of the recycle list in one step
+   void pushChain(T* first, T* last, size_t k) {
+      assert(_key == 0);
+      *((size_t*)last) = (size_t)_first;
+      _first = first;
+      if ((_numElm += k) > _maxElm) _maxElm = _numElm;
    }
+   // Drop the recycled elements
+   // DO NOT release the memory occupied by MemMgr/MemBlock
+   void reset() { clear(); _maxElm = 0; }
+   // Same as reset() but keep the high-water mark
+   void clear() { _first = 0; _numElm = 0; }
 
    // Helper functions
    // ----------------
    // Iterate to the next element after 'p' in the recycle list
    T* getNext(T* p) const {
       // TODO
-      return (T*)(*((size_t*)p));
+      return (T*)(*((size_t*)((char*)p + _link)) ^ _key);
       //return 0;
    }
+   void setNext(T* p, T* n) {
+      *((size_t*)((char*)p + _link)) = (size_t)n ^ _key; }
    //
-   // count the number of elements in the recycle list
-   size_t numElm() const {
-      size_t count = 0;
-      T* p = _first;
-      while (p) {
-         p = getNext(p);
-         ++count;
-      }
-      return count;
-   }
+   // the number of elements in the recycle list, and its high-water mark
+   // since the last reset()
+   size_t numElm() const { return _numElm; }
+   size_t maxElm() const { return _maxElm; }
 
    // Data members
    size_t              _arrSize;   // the array size of the recycled data
    T*                  _first;     // the first recycled data
-   MemRecycleList<T>*  _nextList;  // next MemRecycleList
-                                   //      with _arrSize + x*R_SIZE
+   size_t              _numElm;
+   size_t              _maxElm;
+   size_t              _key;       // the links are XORed with it; 0 but
+                                   // in hardened mode (see MemMgr)
+   size_t              _link;      // the offset of the link; SIZE_T for
+                                   // arrays in hardened mode, so that a
+                                   // freed array keeps its size
+};
+
+// The header of a large object (> block size) mapped on its own.
+// The object follows at hdrSize bytes from it.
+//
+// Make it a private class;
+// Only friend to MemMgr;
+//
+template <class T>
+class MemSpan
+{
+   template <class U, size_t B, class... P> friend class MemMgr;
+
+   static const size_t hdrSize = 6 * SIZE_T;
+
+   // Map a span for an object of 't' bytes at 'h' (>= hdrSize)
+   // Bytes from the start, with the header right before it;
+   // 0 if mmap() fails
+   static MemSpan<T>* map(size_t t, size_t h = hdrSize) {
+      size_t page = sysconf(_SC_PAGESIZE);
+      size_t bytes = (t + h + page - 1) / page * page;
+      void* p = mmap(0, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANON, -1, 0);
+      if (p == MAP_FAILED) return 0;
+      MemSpan<T>* span = (MemSpan<T>*)((char*)p + h - hdrSize);
+      span->_prev = span->_next = 0;
+      span->_size = bytes;
+      span->_base = p;
+      return span;
+   }
+   static void unmap(MemSpan<T>* span) { munmap(span->_base, span->_size); }
+
+   T* getObj() const { return (T*)((char*)this + hdrSize); }
+   static MemSpan<T>* getSpan(T* p) {
+      return (MemSpan<T>*)((char*)p - hdrSize); }
+
+   // Data members
+   MemSpan<T>*  _prev;
+   MemSpan<T>*  _next;
+   size_t       _size;   // #Bytes mapped, including the header
+   void*        _base;   // where the mapping starts
+   size_t       _seq;    // order of mapping (see MemMgr::rollback())
+   size_t       _tag;    // its address XORed with ~MemMgr::_secret
 };
 
+// A thread's private view of MemMgr in MEM_THREAD_CACHE mode.
+// The blocks it carves from are still owned (and deleted) by MemMgr.
+//
+// Make it a private class;
+// Only friend to MemMgr;
+//
 template <class T>
-class MemMgr
+class MemThreadCache
+{
+   template <class U, size_t B, class... P> friend class MemMgr;
+   friend class MemThreadCacheList<T>;
+
+   // Constructor/Destructor
+   MemThreadCache(MemMgrBase<T>* m) : _mgr(m), _block(0), _numRemote(0),
+      _inUse(true), _next(0), _tlsNext(0) {
+      for (int i = 0; i < TC_SIZE; ++i) {
+         _recycleList[i]._arrSize = i; _remoteFree[i] = 0; }
+   }
+   ~MemThreadCache() {}
+
+   // Member functions
+   // Drop the active block and the recycled elements
+   // (they all belong to the blocks MemMgr is releasing)
+   void reset() {
+      _block = 0;
+      for (int i = 0; i < TC_SIZE; ++i) {
+         _recycleList[i].reset(); _remoteFree[i] = 0; }
+      _numRemote = 0;
+   }
+   // Called by any thread but the owner: push 'p' of array size 'n'
+   void pushRemote(T* p, size_t n) {
+      _numRemote.fetch_add(1, memory_order_relaxed);
+      T* first = _remoteFree[n].load(memory_order_relaxed);
+      do { *((size_t*)p) = (size_t)first; }
+      while (!_remoteFree[n].compare_exchange_weak(first, p,
+                memory_order_release, memory_order_relaxed));
+   }
+   // Called by the owner: move the remote frees to _recycleList[]
+   void drainRemote() {
+      for (int i = 0; i < TC_SIZE; ++i) {
+         if (_remoteFree[i].load(memory_order_relaxed) == 0) continue;
+         MemRecycleList<T> l;
+         l._first = _remoteFree[i].exchange(0, memory_order_acquire);
+         _numRemote.fetch_sub(_recycleList[i].takeFront(&l, size_t(-1)),
+                              memory_order_relaxed);
+      }
+   }
+
+   // Data members
+   MemMgrBase<T>*      _mgr;       // 0 if the manager has been destroyed
+   MemBlock<T>*        _block;     // the block this thread bumps from
+   MemRecycleList<T>   _recycleList[TC_SIZE];
+   atomic<T*>          _remoteFree[TC_SIZE];
+                                   // freed by other threads; lock-free
+                                   // pushed, drained by the owner only
+   atomic<size_t>      _numRemote; // #elements in _remoteFree[]; counted
+                                   // before pushed, so never short
+   atomic<bool>        _inUse;     // false if its thread has exited
+   MemThreadCache<T>*  _next;      // next cache registered in _mgr
+   MemThreadCache<T>*  _tlsNext;   // next cache bound to the same thread
+};
+
+// The caches bound to a thread, one for each MemMgr<T> it has used.
+// When the thread exits, they are handed back to their managers so that
+// a later thread can adopt them.
+//
+template <class T>
+class MemThreadCacheList
+{
+   template <class U, size_t B, class... P> friend class MemMgr;
+
+public:
+   ~MemThreadCacheList() {
+      MemThreadCache<T>* c = _head;
+      while (c != 0) {
+         MemThreadCache<T>* n = c->_tlsNext;
+         if (c->_mgr) c->_mgr->releaseThreadCache(c);
+         else delete c;
+         c = n;
+      }
+   }
+
+private:
+   MemThreadCache<T>*  _head;
+};
+
+// The part of MemMgr its thread caches see, whatever its parameters
+template <class T>
+class MemMgrBase
+{
+   friend class MemThreadCacheList<T>;
+
+public:
+   virtual ~MemMgrBase() {}
+
+protected:
+   // The thread owning 'c' has exited
+   virtual void releaseThreadCache(MemThreadCache<T>* c) = 0;
+};
+
+template <class T, size_t BlockSize, class... Policies>
+class MemMgr : public MemMgrBase<T>
 {
    #define S sizeof(T)
+   typedef MemPolicy<Policies...>  P;
+   typedef typename P::Classes     C;
+   typedef typename MemRawOf<T>::Type  Raw;
+   typedef MemMgr<Raw>                 Arena;
+   template <class U, size_t B, class... Q> friend class MemMgr;
+
+   // Where the manager was at mark()
+   struct MemMark {
+      MemBlock<T>*     _block;     // _activeBlock
+      char*            _ptr;       // and its _ptr
+      size_t           _numBlocks;
+      size_t           _liveBytes;
+      size_t           _spanSeq;
+      vector<size_t>   _touched;   // bit i: getListAt(i) has grown since
+      vector<pair<size_t, size_t> >  _numElm;  // (i, #elements before)
+   };
 
 public:
-   MemMgr(size_t b = 65536) : _blockSize(b) {
+   MemMgr(size_t b = BlockSize? BlockSize: 65536,
+          MemThreadMode m = P::thread, MemStore s = MEM_STORE_NEW)
+   : _blockSize(b), _blockBytes(b), _store(s), _numFallback(0),
+     _objAlign(alignof(T) > SIZE_T? alignof(T): SIZE_T), _noStraddle(false),
+     _numBlocks(1), _bigList(0), _bigOrder(0), _liveBytes(0),
+     _maxLive(0), _threadMode(m), _threadBlock(0), _caches(0),
+     _pendingFree(0), _numPending(0), _largeObj(false), _spans(0),
+     _numSpans(0), _spanBytes(0), _release(false), _spareBlock(0),
+     _numSpare(0), _numEmpty(0), _numReleased(0), _fit(false), _fitFreed(0),
+     _numSplit(0), _splitBytes(0), _numMerge(0), _mergeBytes(0),
+     _arena(0), _numSharedObj(0), _numSharedArr(0), _numSharing(0),
+     _spanSeq(0), _trace(0), _hardened(false), _canaryBytes(0),
+     _hardAlign(0), _numDoubleFree(0), _numOverflow(0), _numBadLink(0),
+     _numBadFree(0) {
       assert(b % SIZE_T == 0);
-      _activeBlock = new MemBlock<T>(0, _blockSize);
-      for (int i = 0; i < R_SIZE; ++i)
+      assert(BlockSize == 0 || b == BlockSize);
+      assert(!P::fixedThread || m == P::thread);
+      // Any value will do; its low bits make a link written over a free
+      // chunk decode to a misaligned pointer
+      _secret = ((size_t(this) ^ size_t(chrono::steady_clock::now()
+                  .time_since_epoch().count())) * 0x9e3779b97f4a7c15ull) |
+                SIZE_T_1;
+      for (size_t i = 0; i < C::size; ++i)
          _recycleList[i]._arrSize = i;
+      initBigList();
+      _activeBlock = newBlock(0);
+      clearStats();
+      for (int i = 0; i < TC_SIZE; ++i)
+         _numCentral[i] = 0;
+      #ifdef MEM_DEBUG
+      memLog().setOn(true);
+      #endif // MEM_DEBUG
+   }
+   ~MemMgr() {
+      delete _trace; _trace = 0;
+      reset(); MemBlock<T>::destroy(_activeBlock);
+      delete [] _bigList; delete [] _bigOrder;
+      // Caches still bound to live threads are deleted when they exit
+      while (_caches != 0) {
+         MemThreadCache<T>* c = _caches;
+         _caches = c->_next;
+         if (c->_inUse) c->_mgr = 0;
+         else delete c;
+      }
+   }
+
+   // Align every object, and the elements of every array, to 'a' (a power
+   // of 2, or 0 for alignof(T)); never below alignof(T) or SIZE_T.
+   // With no-straddle on, an object never crosses a MEM_LINE boundary;
+   // one bigger than MEM_LINE starts on a boundary instead.
+   // Fit mode is off while either is in use. The manager is reset.
+   void setAlign(size_t a) {
+      assert((a & (a - 1)) == 0);
+      if (a < alignof(T)) a = alignof(T);
+      if (a < SIZE_T) a = SIZE_T;
+      if (_objAlign != a) { _objAlign = a; initBigList(); reset(); }
+   }
+   size_t getAlign() const { return _objAlign; }
+   void setNoStraddle(bool s) {
+      if (_noStraddle != s) { _noStraddle = s; initBigList(); reset(); } }
+   bool getNoStraddle() const { return _noStraddle; }
+   // Take the memory of T from the arena shared by every type of the same
+   // rounded size and alignment (memArena()), and only count here what T
+   // has in use. MEM_THREAD_NONE only; the other modes and the block size
+   // of this manager do not apply to the arena, but large objects do.
+   // The manager is reset; the arena is never reset, so the objects of T
+   // must be deleted before switching, or they stay in the arena.
+   void setShared(bool s) {
+      if ((_arena != 0) == s) return;
+      if (s) { _arena = memArena<Raw>(); ++(_arena->_numSharing); }
+      else { --(_arena->_numSharing); _arena = 0; }
+      initBigList();
+      reset();
+   }
+   bool getShared() const { return _arena != 0; }
+   // Record every alloc(), allocArr(), free(), freeArr() and reset() to
+   // the binary trace file 'name' (see memTrace.h), or stop if 'name' is
+   // empty. Batches are traced, and so done, one by one.
+   // Return false if the file cannot be written.
+   bool setTrace(const string& name) {
+      if (_trace != 0) _trace->close();
+      if (!name.empty()) {
+         if (_trace == 0) _trace = new MemTracer;
+         _trace->setLocked(threadMode() == MEM_THREAD_CACHE);
+         if (_trace->open(name, S, _objAlign, blockSize())) return true;
+      }
+      delete _trace; _trace = 0;
+      return name.empty();
+   }
+   const MemTracer* getTrace() const { return _trace; }
+   // Switch the store of the blocks; the manager is reset
+   void setStore(MemStore s) { if (_store != s) { _store = s; reset(); } }
+   MemStore getStore() const { return _store; }
+   // In hardened mode, every free is checked:
+   // - a double free is found in the free map of its block; it is
+   //   reported and ignored;
+   // - a canary after each chunk is checked; an overflow is reported
+   //   (the chunk is still recycled);
+   // - the recycle-list links are XORed with a secret; a link written
+   //   over a free chunk is reported and its list dropped.
+   // MEM_THREAD_NONE only, and no fit or marks; the blocks are aligned
+   // as for empty-block release. The manager is reset.
+   // It is not free ("memBench core"): new/delete of an object costs
+   // 10-30% more, freeing in random order 50-80% more (the canary makes
+   // the chunks bigger, and the free map is another line to touch), and
+   // taking or dropping blocks about twice as much (they are mapped).
+   void setHardened(bool h) {
+      if (_hardened != h) { _hardened = h; initBigList(); reset(); } }
+   bool getHardened() const { return _hardened; }
+   // #double frees, overflows, bad links and frees of large objects
+   // that are not found since the last reset()
+   size_t getNumDoubleFree() const { return _numDoubleFree; }
+   size_t getNumOverflow() const { return _numOverflow; }
+   size_t getNumBadLink() const { return _numBadLink; }
+   size_t getNumBadFree() const { return _numBadFree; }
+   // Switch the thread mode. The manager is reset, so no objects may be
+   // alive and no other thread may be using it.
+   void setThreadMode(MemThreadMode m) {
+      assert(!P::fixedThread || m == P::thread);
+      _threadMode = m;
+      initBigList();
+      reset();
+      if (_trace != 0) _trace->setLocked(threadMode() == MEM_THREAD_CACHE);
+   }
+   MemThreadMode getThreadMode() const { return threadMode(); }
+   // With large objects on, requests bigger than the block size are
+   // mapped as spans of their own instead of raising bad_alloc.
+   // Live spans are still released by free()/freeArr() after turning
+   // it off.
+   void setLargeObj(bool l) { _largeObj = l; }
+   bool getLargeObj() const { return _largeObj; }
+   // With empty-block release on, every block counts its live objects.
+   // Once MEM_RELEASE_BATCH blocks have been emptied by free(), the empty
+   // ones are unlinked and their recycled elements purged; up to
+   // MEM_SPARE_MAX of them are kept for reuse and the rest are deleted.
+   // Only in MEM_THREAD_NONE mode; the manager is reset.
+   void setReleaseEmpty(bool r) {
+      if (_release != r) { _release = r; initBigList(); reset(); } }
+   bool getReleaseEmpty() const { return _release; }
+   // Unlink the blocks with no live objects (but _activeBlock), purge
+   // their elements from the recycle lists, and keep (at most
+   // MEM_SPARE_MAX of) them for reuse or delete them.
+   // Return the number of blocks released.
+   size_t releaseEmptyBlocks() {
+      _numEmpty = 0;
+      if (!isRelease()) return 0;
+      size_t count = 0;
+      for (MemBlock<T>* blk = _activeBlock->_nextBlock; blk != 0;
+           blk = blk->_nextBlock)
+         if (blk->_numLive == 0) { blk->_empty = true; ++count; }
+      if (count == 0) return 0;
+      for (size_t i = 0; i < C::size; ++i)
+         purgeEmpty(&(_recycleList[i]));
+      for (size_t i = 0; i < _numBigList; ++i)
+         purgeEmpty(&(_bigList[i]));
+      MemBlock<T>* prev = _activeBlock;
+      while (prev->_nextBlock != 0) {
+         MemBlock<T>* blk = prev->_nextBlock;
+         if (!blk->_empty) { prev = blk; continue; }
+         prev->_nextBlock = blk->_nextBlock;
+         --_numBlocks;
+         logEvent(MEM_LOG_RELEASE_BLOCK, size_t(blk));
+         if (_numSpare < MEM_SPARE_MAX) {
+            blk->reset();
+            blk->_nextBlock = _spareBlock;
+            _spareBlock = blk;
+            ++_numSpare;
+         }
+         else
+            MemBlock<T>::destroy(blk);
+      }
+      _numReleased += count;
+      return count;
+   }
+   // With fit on, a request missing its own recycle list splits the
+   // smallest bigger free chunk instead of bumping _activeBlock. Once a
+   // block's worth of bytes has been recycled, the chunks recycled since
+   // the last time are coalesced before a new block is taken, up to
+   // MEM_COALESCE_BATCH of them a time; so it costs the same however many
+   // chunks are free.
+   // The blocks are then aligned (see getBlockAlign()), each mapped in a
+   // window of its power-of-2 size, which getFootprint() counts.
+   // Only in MEM_THREAD_NONE mode; the manager is reset.
+   void setFit(bool f) {
+      if (_fit != f) { _fit = f; initBigList(); reset(); } }
+   bool getFit() const { return _fit; }
+   // Merge the adjacent free chunks in the recycle lists into bigger ones,
+   // and give a free tail of _activeBlock back to it.
+   // Return the number of Bytes merged.
+   size_t coalesce() { return coalesceLists(false); }
+   // coalesce() on all the free chunks, or if 'recent', only on up to
+   // MEM_COALESCE_BATCH of those recycled since the last time: as the
+   // lists are LIFO, they are (at most) the first _fitNew[i] of list i.
+   // The older chunks next to them are left apart until coalesce().
+   size_t coalesceLists(bool recent) {
+      _fitFreed = 0;
+      if (!isFit()) return 0;
+      size_t left = MEM_COALESCE_BATCH;
+      // (chunk, its list size)
+      vector<pair<char*, size_t> > chunks;
+      for (size_t i = 0, nl = getNumLists(); i < nl; ++i) {
+         MemRecycleList<T>* l = getListAt(i);
+         if (!recent) {
+            for (T* p = l->_first; p != 0; p = l->getNext(p))
+               chunks.push_back(make_pair((char*)p, l->_arrSize));
+            l->clear();
+            continue;
+         }
+         for (; _fitNew[i] > 0 && l->_first != 0 && left > 0; --left) {
+            chunks.push_back(make_pair((char*)l->popFront(), l->_arrSize));
+            --_fitNew[i];
+         }
+         if (l->_first == 0) _fitNew[i] = 0;
+      }
+      // (the bits of the lists emptied are dropped by getFitMem())
+      if (!recent) fill(_fitMap.begin(), _fitMap.end(), 0);
+      sort(chunks.begin(), chunks.end());
+      // Chunks in different blocks are never adjacent: each block starts
+      // with its MemBlock header (and its free map in hardened mode), so
+      // the end of a block never runs into the first chunk of another
+      size_t numMerge = 0, bytes = 0;
+      for (size_t i = 0, j = 0; i < chunks.size(); i = j) {
+         char* p = chunks[i].first;
+         size_t b = getChunkSize(chunks[i].second);
+         for (j = i + 1; j < chunks.size() && chunks[j].first == p + b; ++j)
+            b += getChunkSize(chunks[j].second);
+         if (p + b == _activeBlock->_ptr) {
+            _activeBlock->_ptr = p;
+            numMerge += j - i; bytes += b;
+         }
+         else if (j - i == 1)
+            recycle((T*)p, chunks[i].second);
+         else {
+            recycle((T*)p, getFitSize(b));
+            numMerge += j - i - 1; bytes += b;
+         }
+      }
+      logEvent(MEM_LOG_COALESCE, bytes, numMerge);
+      _numMerge += numMerge;
+      _mergeBytes += bytes;
+      // The chunks left in _fitNew[] wait for the next time; those just
+      // recycled are also counted in it, to be merged with their
+      // neighbors freed after them.
+      _fitFreed = 0;
+      if (!recent) fill(_fitNew.begin(), _fitNew.end(), 0);
+      return bytes;
+   }
+   // Checkpoints: mark() records where _activeBlock is, and rollback(m)
+   // releases all that was allocated since mark 'm' at once, in O(#blocks)
+   // plus the chunks recycled since then; the destructors are not called.
+   // Marks nest; rolling back to 'm' drops the marks after it, and reset()
+   // drops them all.
+   // While marked, allocations only bump the blocks and what is freed is
+   // not reused until the rollback.
+   // Only in MEM_THREAD_NONE mode, and not in shared, release or fit mode
+   // (see canMark()).
+   size_t mark() {
+      assert(canMark());
+      MemMark k;
+      k._block = _activeBlock;
+      k._ptr = _activeBlock->_ptr;
+      k._numBlocks = _numBlocks;
+      k._liveBytes = _liveBytes;
+      k._spanSeq = _spanSeq;
+      k._touched.assign((getNumLists() + 63) / 64, 0);
+      _marks.push_back(k);
+      logEvent(MEM_LOG_MARK, 0, _marks.size() - 1);
+      return _marks.size() - 1;
+   }
+   // 1. Keep the chunks recycled since the mark that were allocated
+   //    before it, and drop the others
+   // 2. Turn the blocks taken since then into spares (up to
+   //    MEM_SPARE_MAX) and move _activeBlock back
+   // 3. Unmap the large spans mapped since then
+   void rollback(size_t m) {
+      assert(m < _marks.size());
+      logEvent(MEM_LOG_ROLLBACK, 0, m);
+      const MemMark& k = _marks[m];
+      // The memory carved since the mark, sorted by address
+      vector<pair<char*, char*> > since;
+      since.push_back(make_pair(k._ptr, k._block->_end));
+      for (MemBlock<T>* blk = _activeBlock; blk != k._block;
+           blk = blk->_nextBlock)
+         since.push_back(make_pair(blk->_begin, blk->_end));
+      sort(since.begin(), since.end());
+      // 1. The lists have only grown since the mark; pop each one back
+      // to its size before it was first touched (see touchList()), from
+      // the last mark back to mark 'm'
+      vector<pair<T*, size_t> > keep;
+      size_t keepBytes = 0;
+      for (size_t j = _marks.size(); j-- > m; ) {
+         const vector<pair<size_t, size_t> >& t = _marks[j]._numElm;
+         for (size_t r = 0; r < t.size(); ++r) {
+            MemRecycleList<T>* l = getListAt(t[r].first);
+            while (l->_numElm > t[r].second) {
+               T* p = l->popFront();
+               if (isCarvedIn((char*)p, since)) continue;
+               keep.push_back(make_pair(p, l->_arrSize));
+               keepBytes += getChunkSize(l->_arrSize);
+            }
+         }
+      }
+      // 2.
+      while (_activeBlock != k._block) {
+         MemBlock<T>* blk = _activeBlock;
+         _activeBlock = blk->_nextBlock;
+         if (_numSpare < MEM_SPARE_MAX) {
+            blk->reset();
+            blk->_nextBlock = _spareBlock;
+            _spareBlock = blk;
+            ++_numSpare;
+         }
+         else
+            MemBlock<T>::destroy(blk);
+      }
+      _activeBlock->_ptr = k._ptr;
+      _numBlocks = k._numBlocks;
+      // 3. The spans are pushed to the front, so the newer ones come first
+      while (_spans != 0 && _spans->_seq > k._spanSeq) {
+         MemSpan<T>* span = _spans;
+         _spans = span->_next;
+         --_numSpans; _spanBytes -= span->_size;
+         MemSpan<T>::unmap(span);
+      }
+      if (_spans != 0) _spans->_prev = 0;
+      // What was live at the mark, less what of it has been freed since
+      _liveBytes = (k._liveBytes > keepBytes)? k._liveBytes - keepBytes: 0;
+      _marks.resize(m);
+      for (size_t i = 0; i < keep.size(); ++i)
+         recycle(keep[i].first, keep[i].second);
+   }
+   size_t getNumMarks() const { return _marks.size(); }
+   bool canMark() const {
+      return threadMode() == MEM_THREAD_NONE && !isShared() &&
+             !isRelease() && !isFit() && !isHardened();
    }
-   ~MemMgr() { reset(); delete _activeBlock; }
 
    // 1. Remove the memory of all but the firstly allocated MemBlocks
    //    That is, the last MemBlock searchd from _activeBlock.
@@ -220,121 +1052,436 @@ public:
    // 4. Update the _activeBlock pointer
    void reset(size_t b = 0) {
       assert(b % SIZE_T == 0);
-      #ifdef MEM_DEBUG
-      cout << "Resetting memMgr...(" << b << ")" << endl;
-      #endif // MEM_DEBUG
+      assert(BlockSize == 0 || b == 0 || b == BlockSize);
+      logEvent(MEM_LOG_RESET, 0, b);
       // TODO
-
-      while (true) {
-        if (_activeBlock->getNextBlock() == 0){ // no more blocks
-          break;
-        }
-        else {
-          MemBlock<T>* block2beDeleted = _activeBlock;
-          _activeBlock = _activeBlock->getNextBlock();
-          block2beDeleted->_ptr = 0;
-          block2beDeleted->_end = 0;
-          block2beDeleted->_nextBlock = 0;
-          delete[] block2beDeleted->_begin;
-          block2beDeleted->_begin = 0;
-          delete block2beDeleted;
-          block2beDeleted = 0;
-        }
+      // Thread caches only hold blocks and elements of this manager;
+      // reset() must not run concurrently with any allocation
+      for (MemThreadCache<T>* c = _caches; c != 0; c = c->_next)
+         c->reset();
+      while (_threadBlock != 0) {
+         MemBlock<T>* blk = _threadBlock;
+         _threadBlock = blk->_nextBlock;
+         MemBlock<T>::destroy(blk);
       }
-
-      if (b == 0 || b == _blockSize){ // no need to change block size
-        _activeBlock->reset();
+      for (int i = 0; i < TC_SIZE; ++i)
+         _numCentral[i] = 0;
+      while (_spans != 0) {
+         MemSpan<T>* span = _spans;
+         _spans = span->_next;
+         MemSpan<T>::unmap(span);
       }
-      else {                          // need to change block size
-        _activeBlock->_ptr = 0;
-        _activeBlock->_end = 0;
-        delete[] _activeBlock->_begin;
-        _activeBlock->_begin = 0;
-        delete _activeBlock;
-        _activeBlock = 0;
-        _activeBlock = new MemBlock<T>(0, b);
+      _numSpans = _spanBytes = 0;
+      while (_spareBlock != 0) {
+         MemBlock<T>* blk = _spareBlock;
+         _spareBlock = blk->_nextBlock;
+         MemBlock<T>::destroy(blk);
       }
-
-      if (b != _blockSize && b != 0){
-        _blockSize = b;
+      _numSpare = _numEmpty = _numReleased = 0;
+      _numDoubleFree = _numOverflow = _numBadLink = _numBadFree = 0;
+      _fitFreed = _numSplit = _splitBytes = _numMerge = _mergeBytes = 0;
+      while (_activeBlock->getNextBlock() != 0) {
+         MemBlock<T>* blk = _activeBlock;
+         _activeBlock = blk->getNextBlock();
+         MemBlock<T>::destroy(blk);
+      }
+      if (b != 0 && b != _blockSize) {
+         _blockSize = b;
+         initBigList();
+      }
+      // Reallocate the first block if its size, alignment, store or free
+      // map is out of date (in shared mode, it is an empty stub)
+      _numFallback = 0;
+      if (isShared()? _activeBlock->getSize() != 0:
+          _activeBlock->getSize() != _blockBytes ||
+          _activeBlock->_align != getBlockAlign() ||
+          _activeBlock->_store != _store ||
+          (_activeBlock->_freeMap != 0) != isHardened()) {
+         MemBlock<T>::destroy(_activeBlock);
+         _activeBlock = newBlock(0);
+      }
+      else {
+         _activeBlock->reset();
+         if (_activeBlock->_fallback) ++_numFallback;
       }
+      _numBlocks = 1;
+      _liveBytes = _maxLive = 0;
+      clearStats();
+      _numSharedObj = _numSharedArr = 0;
+      _marks.clear();
+      _pendingFree = 0;
+      _numPending = 0;
 
       //reset _recycleList[]
-      for (int i = 0; i < 256; i++){
+      for (size_t i = 0; i < C::size; i++){
         _recycleList[i].reset();
       }
-
+      for (size_t i = 0; i < _numBigList; ++i) {
+         _bigList[i].reset(); _bigOrder[i] = 0; }
+      _numBigUsed = 0;
+      fill(_fitMap.begin(), _fitMap.end(), 0);
+      fill(_fitNew.begin(), _fitNew.end(), 0);
+      if (_trace != 0) _trace->put(MEM_TRACE_RESET, 0, blockSize());
    }
    // Called by new
    T* alloc(size_t t) {
       assert(t == S);
-      #ifdef MEM_DEBUG
-      cout << "Calling alloc...(" << t << ")" << endl;
-      #endif // MEM_DEBUG
-      return getMem(t);
+      logEvent(MEM_LOG_ALLOC, 0, t);
+      T* ret = getMem(t);
+      if (_trace != 0) _trace->put(MEM_TRACE_ALLOC, ret, t);
+      return ret;
+   }
+   // Called for 'n' objects at once (e.g. by MemTest::deleteObjs()), whose
+   // destructors have been called; p[0, n) are linked into one chain and
+   // spliced to _recycleList[0] in one step.
+   void freeBatch(size_t n, T** p) {
+      if (n == 0) return;
+      // one by one, to trace or log each of them
+      if (_trace != 0 || isLogged()) {
+         for (size_t i = 0; i < n; ++i) free(p[i]);
+         return;
+      }
+      if (isShared()) {
+         _arena->freeBatch(n, (Raw**)p);
+         _numSharedObj -= n;
+         countShared(n * sizeof(Raw), false);
+         return;
+      }
+      if (!fitsBlock(0) || threadMode() == MEM_THREAD_CACHE ||
+          isHardened()) {
+         for (size_t i = 0; i < n; ++i) free(p[i]);
+         return;
+      }
+      for (size_t i = 1; i < n; ++i)
+         *((size_t*)p[i - 1]) = (size_t)p[i];
+      recycleChain(p[0], p[n - 1], n, 0);
+      countFree(0, n);
+      for (size_t i = 0; i < n; ++i)
+         putLive(p[i], getChunkSize(0));
+   }
+   // Same as freeBatch() for the arrays p[0, n), as passed to delete[];
+   // each run of arrays of the same size is spliced in one step
+   void freeArrBatch(size_t n, T** p) {
+      if (threadMode() == MEM_THREAD_CACHE || isShared() || _trace != 0 ||
+          isLogged() || isHardened()) {
+         for (size_t i = 0; i < n; ++i) freeArr(p[i]);
+         return;
+      }
+      for (size_t i = 0, j = 0; i < n; i = j) {
+         size_t an = *((size_t*)p[i]);
+         if (!fitsBlock(an)) {
+            freeLargeMem(p[i]);
+            j = i + 1;
+            continue;
+         }
+         for (j = i + 1; j < n && *((size_t*)p[j]) == an; ++j)
+            *((size_t*)p[j - 1]) = (size_t)p[j];
+         size_t ln = getListSize(an);
+         recycleChain(p[i], p[j - 1], j - i, ln);
+         countFree(ln, j - i);
+         for (size_t k = i; k < j; ++k)
+            putLive(p[k], getChunkSize(ln));
+      }
    }
    // Called by new[]
    T* allocArr(size_t t) {
-      #ifdef MEM_DEBUG
-      cout << "Calling allocArr...(" << t << ")" << endl;
-      #endif // MEM_DEBUG
+      logEvent(MEM_LOG_ALLOC_ARR, 0, t);
       // Note: no need to record the size of the array == > system will do
-      return getMem(t);
+      T* ret = getMem(t);
+      if (_trace != 0) _trace->put(MEM_TRACE_ALLOC_ARR, ret, t);
+      return ret;
+   }
+   // Called for 'n' objects at once (e.g. by MemTest::newObjs());
+   // the memory for them is stored in out[0, n).
+   // The run in _recycleList[0] is drained first, and the rest is carved
+   // from _activeBlock with one bounds check per block. If bad_alloc is
+   // thrown, the objects already allocated are recycled.
+   void allocBatch(size_t n, T** out) {
+      size_t i = 0;
+      try {
+         // one by one, to trace or log each of them
+         if (_trace != 0 || isLogged()) {
+            for (; i < n; ++i) out[i] = alloc(S);
+            return;
+         }
+         if (isShared()) {
+            checkShared(sizeof(Raw));
+            _arena->allocBatch(n, (Raw**)out);
+            i = n;
+            _numSharedObj += n;
+            countShared(n * sizeof(Raw), true);
+            return;
+         }
+         size_t t = getChunkSize(0);
+         if (!fitsBlock(0) || threadMode() == MEM_THREAD_CACHE ||
+             isHardened()) {
+            for (; i < n; ++i) out[i] = getMem(S);
+            return;
+         }
+         for (MemRecycleList<T>* l = &(_recycleList[0]);
+              i < n && l->_first != 0 && _marks.empty(); ++i) {
+            out[i] = l->popFront();
+            getLive(out[i], t);
+            countAlloc(0);
+            if (isStat()) ++_stat._numHit;
+         }
+         while (i < n) {
+            // Once the first object is placed, the others stay aligned
+            // as 't' is a multiple of _objAlign; not so for no-straddle
+            char* p = placeChunk(_activeBlock->_ptr, 0, t);
+            size_t skip = p - _activeBlock->_ptr;
+            size_t r = _activeBlock->getRemainSize();
+            size_t k = (r >= skip + t)? (r - skip) / t: 0;
+            if (k == 0) {
+               // may split or coalesce in fit mode
+               if (isFit()) { countAlloc(0); out[i++] = getCentralMem(t, 0); }
+               else switchBlock();
+               continue;
+            }
+            if (_noStraddle) k = 1;
+            if (k > n - i) k = n - i;
+            getLive((T*)p, t, k);
+            countAlloc(0, k);
+            if (isStat()) _stat._numBump += k;
+            for (size_t j = 0; j < k; ++j, p += t)
+               out[i++] = (T*)p;
+            _activeBlock->_ptr = p;
+         }
+      }
+      catch (bad_alloc&) {
+         while (i != 0) free(out[--i]);
+         throw;
+      }
    }
    // Called by delete
    void  free(T* p) {
-      #ifdef MEM_DEBUG
-      cout << "Calling free...(" << p << ")" << endl;
-      #endif // MEM_DEBUG
-      getMemRecycleList(0)->pushFront(p);
+      logEvent(MEM_LOG_FREE, size_t(p));
+      if (_trace != 0) _trace->put(MEM_TRACE_FREE, p, S);
+      if (isShared()) {
+         _arena->free((Raw*)p);
+         --_numSharedObj;
+         countShared(sizeof(Raw), false);
+      }
+      else if (!fitsBlock(0))
+         freeLargeMem(p);
+      else if (threadMode() == MEM_THREAD_CACHE)
+         putThreadMem(p, 0);
+      else if (!isHardened() || checkFree(p, 0)) {
+         recycle(p, 0);
+         countFree(0);
+         putLive(p, getChunkSize(0));
+      }
    }
    // Called by delete[]
    void  freeArr(T* p) {
-      #ifdef MEM_DEBUG
-      cout << "Calling freeArr...(" << p << ")" << endl;
-      #endif // MEM_DEBUG
+      logEvent(MEM_LOG_FREE_ARR, size_t(p));
       // TODO
       // Get the array size 'n' stored by system,
       // which is also the _recycleList index
+      // (in hardened mode, only once 'p' is known to be in use)
       size_t n = 0;
+      if (isHardened() && !checkArr(p)) return;
       n = *((size_t*)p);
-      #ifdef MEM_DEBUG
-      cout << ">> Array size = " << n << endl;
-      cout << "Recycling " << p << " to _recycleList[" << n << "]" << endl;
-      #endif // MEM_DEBUG
+      if (_trace != 0) _trace->put(MEM_TRACE_FREE_ARR, p, n * S + SIZE_T);
+      if (isShared()) {
+         // The arena knows the array by its #Raw elements
+         size_t m = getSharedArrSize(n);
+         *((size_t*)p) = m;
+         _arena->freeArr((Raw*)p);
+         --_numSharedArr;
+         countShared(m * sizeof(Raw) + SIZE_T, false);
+         return;
+      }
+      if (!fitsBlock(n)) {
+         logEvent(MEM_LOG_ARR_SIZE, 0, n);
+         freeLargeMem(p);
+         return;
+      }
+      size_t ln = getListSize(n);
+      logEvent(MEM_LOG_ARR_SIZE, 0, n);
+      logEvent(MEM_LOG_RECYCLING, size_t(p), ln);
       // add to recycle list...
-      getMemRecycleList(n)->pushFront(p);
+      if (threadMode() != MEM_THREAD_CACHE) {
+         if (isHardened() && !checkFree(p, ln)) return;
+         recycle(p, ln);
+         countFree(ln);
+         putLive(p, getChunkSize(ln));
+      }
+      else if (ln < TC_SIZE)
+         putThreadMem(p, ln);
+      else
+         pushPendingFree(p, ln);
    }
    void print() const {
       cout << "=========================================" << endl
            << "=              Memory Manager           =" << endl
-           << "=========================================" << endl
-           << "* Block size            : " << _blockSize << " Bytes" << endl
-           << "* Number of blocks      : " << getNumBlocks() << endl
-           << "* Free mem in last block: " << _activeBlock->getRemainSize()
-           << endl
-           << "* Recycle list          : " << endl;
-      int i = 0, count = 0;
-      while (i < R_SIZE) {
-         const MemRecycleList<T>* ll = &(_recycleList[i]);
-         while (ll != 0) {
-            size_t s = ll->numElm();
-            if (s) {
-               cout << "[" << setw(3) << right << ll->_arrSize << "] = "
-                    << setw(10) << left << s;
-               if (++count % 4 == 0) cout << endl;
-            }
-            ll = ll->_nextList;
-         }
-         ++i;
+           << "=========================================" << endl;
+      if (isShared()) {
+         const Arena* a = _arena;
+         cout << "* Shared arena          : " << sizeof(Raw)
+              << "-Byte objects of " << a->_numSharing << " type(s)" << endl
+              << "* Objects / arrays      : " << _numSharedObj << " / "
+              << _numSharedArr << " (" << _liveBytes << " Bytes, max "
+              << _maxLive << ")" << endl;
+         a->printBlocks();
       }
-      cout << endl;
+      else printBlocks();
+   }
+
+   // Statistics; none of them walks the lists or the blocks
+   size_t getNumBlocks() const { return _numBlocks; }
+   size_t getBlockSize() const { return blockSize(); }
+   // #Bytes mapped for the live large spans
+   size_t getSpanBytes() const { return _spanBytes; }
+   // #Bytes taken from the store: the blocks, with their headers, as
+   // mapped (see MemBlock::getStoreBytes()), and the large spans. The
+   // blocks are all made alike, so each takes what the active one does.
+   size_t getFootprint() const {
+      return _numBlocks * _activeBlock->getStoreBytes() + _spanBytes;
+   }
+   // #Bytes of the objects in use in the blocks, and its high-water mark
+   // since the last reset(); MEM_THREAD_NONE only. In shared mode, those
+   // of T in the arena.
+   size_t getLiveBytes() const { return _liveBytes; }
+   size_t getMaxLiveBytes() const { return _maxLive; }
+   // #elements and #Bytes in the central recycle lists; O(#lists)
+   size_t getNumRecycled() const {
+      size_t count = 0;
+      for (size_t i = 0; i < C::size; ++i)
+         count += _recycleList[i].numElm();
+      for (size_t i = 0; i < _numBigList; ++i)
+         count += _bigList[i].numElm();
+      return count;
+   }
+   size_t getRecycledBytes() const {
+      size_t bytes = 0;
+      for (size_t i = 0; i < C::size; ++i)
+         bytes += _recycleList[i].numElm() * getChunkSize(i);
+      for (size_t i = 0; i < _numBigList; ++i)
+         bytes += _bigList[i].numElm() * getChunkSize(_bigList[i]._arrSize);
+      return bytes;
+   }
+   // The counters since the last reset() or clearStats(); in shared mode,
+   // those of the arena (but the live Bytes)
+   const MemStat& getStat() const {
+      return isShared()? _arena->_stat: _stat; }
+   // #allocations and #frees of array size 'n' (a list size; see
+   // getListSize()), 0 for the objects
+   size_t getClassAllocs(size_t n) const {
+      return _classAlloc[getListIdx(n)]; }
+   size_t getClassFrees(size_t n) const {
+      return _classFree[getListIdx(n)]; }
+   // Zero the counters; the peak of the live Bytes restarts from now
+   void clearStats() {
+      _stat.clear();
+      fill(_classAlloc.begin(), _classAlloc.end(), 0);
+      fill(_classFree.begin(), _classFree.end(), 0);
+      _maxLive = _liveBytes;
+      _statStart = chrono::steady_clock::now();
+   }
+   void printStats() const {
+      cout << "=========================================" << endl
+           << "=           Memory Statistics           =" << endl
+           << "=========================================" << endl;
+      if (isShared()) {
+         cout << "* Shared arena          : " << sizeof(Raw)
+              << "-Byte objects of " << _arena->_numSharing << " type(s)"
+              << endl;
+         _arena->printCounters();
+      }
+      else printCounters();
+      cout << "* Live Bytes            : " << _liveBytes << " (peak "
+           << _maxLive << ")" << endl;
+      if (!isStat())
+         cout << "* (counted in MEM_THREAD_NONE mode with MemStats<true> only)"
+              << endl;
    }
 
 private:
    size_t                     _blockSize;
+   size_t                     _blockBytes;   // see initBlockBytes()
+   MemStore                   _store;
+   size_t                     _numFallback;  // MEM_STORE_HUGE blocks on
+                                             // plain pages since reset()
+   size_t                     _objAlign;     // see setAlign()
+   bool                       _noStraddle;
    MemBlock<T>*               _activeBlock;
-   MemRecycleList<T>          _recycleList[R_SIZE];
+   size_t                     _numBlocks;    // in the chain and the caches
+   MemRecycleList<T>          _recycleList[C::size];
+   MemRecycleList<T>*         _bigList;      // see initBigList()
+   size_t*                    _bigOrder;     // order of first use; 0: none
+   size_t                     _numBigList;
+   size_t                     _numBigUsed;
+   size_t                     _flatEnd;
+   size_t                     _maxArr;       // the biggest array in a block
+
+   // MEM_THREAD_NONE only
+   size_t                     _liveBytes;    // see getLiveBytes()
+   size_t                     _maxLive;
+   MemStat                    _stat;         // see getStat()
+   vector<size_t>             _classAlloc;   // of each list (getListAt())
+   vector<size_t>             _classFree;
+   chrono::steady_clock::time_point  _statStart;
+
+   // for MEM_THREAD_CACHE
+   MemThreadMode              _threadMode;
+   MemBlock<T>*               _threadBlock;  // blocks given to the caches
+   MemThreadCache<T>*         _caches;       // all caches ever bound
+   atomic<size_t>             _numCentral[TC_SIZE];
+                                             // #elements in _recycleList[]
+   atomic<T*>                 _pendingFree;  // see pushPendingFree()
+   atomic<size_t>             _numPending;
+
+   // for large objects
+   bool                       _largeObj;
+   MemSpan<T>*                _spans;        // all live spans
+   size_t                     _numSpans;
+   size_t                     _spanBytes;
+
+   // for empty-block release
+   bool                       _release;
+   MemBlock<T>*               _spareBlock;   // released blocks for reuse
+   size_t                     _numSpare;
+   size_t                     _numEmpty;     // #blocks emptied by free()
+   size_t                     _numReleased;  // since the last reset()
+
+   // for split/coalesce
+   bool                       _fit;
+   vector<size_t>             _fitMap;       // bit i: getListAt(i) may
+                                             // be non-empty
+   size_t                     _fitFreed;     // #Bytes recycled since the
+                                             // last coalesce()
+   vector<size_t>             _fitNew;       // #chunks pushed to each
+                                             // list since then
+   size_t                     _numSplit;
+   size_t                     _splitBytes;   // #Bytes served by splits
+   size_t                     _numMerge;
+   size_t                     _mergeBytes;   // #Bytes in merged chunks
+
+   // for shared mode (MEM_THREAD_NONE only)
+   Arena*                     _arena;        // 0 if not shared
+   size_t                     _numSharedObj; // of T in the arena
+   size_t                     _numSharedArr;
+   size_t                     _numSharing;   // #types using this as arena
+
+   // for mark/rollback
+   vector<MemMark>            _marks;        // see mark()
+   size_t                     _spanSeq;      // #spans ever mapped
+
+   MemTracer*                 _trace;        // 0 if not tracing
+
+   // for hardened mode (MEM_THREAD_NONE only)
+   bool                       _hardened;
+   size_t                     _canaryBytes;  // SIZE_T if isHardened()
+   size_t                     _hardAlign;    // getBlockAlign() if so
+   size_t                     _secret;       // the list keys and canaries
+   size_t                     _numDoubleFree;
+   size_t                     _numOverflow;
+   size_t                     _numBadLink;
+   size_t                     _numBadFree;
+   mutex                      _mutex;        // guards all of the above
+                                             // but the caches themselves
+   static thread_local MemThreadCacheList<T>  _tlsCaches;
 
    // Private member functions
    //
@@ -351,99 +1498,284 @@ private:
       return ((t - SIZE_T)/ S);
       return 0;
    }
-   // Go through _recycleList[m], its _nextList, and _nexList->_nextList, etc,
-   //    to find a recycle list whose "_arrSize" == "n"
-   // If not found, create a new MemRecycleList with _arrSize = n
-   //    and add to the last MemRecycleList
-   // So, should never return NULL
-   // [Note]: This function will be called by MemMgr->getMem() to get the
-   //         recycle list. Therefore, the recycle list is first created
-   //         by the MTNew command, not MTDelete.
+   // The block size and thread mode, folded to constants if fixed by the
+   // template parameters
+   size_t blockSize() const { return BlockSize? BlockSize: _blockSize; }
+   MemThreadMode threadMode() const {
+      return P::fixedThread? P::thread: _threadMode; }
+   // Return the recycle list of array size 'n' in O(1).
+   // 'n' must be a list size, i.e. n == getListSize(n)
+   // [Note]: The lists are all created by initBigList() when the block
+   //         size is set, so getMem() never allocates one.
    MemRecycleList<T>* getMemRecycleList(size_t n) {
-      size_t m = n % R_SIZE;
-      // TODO
-      MemRecycleList<T>* returnValue = &(_recycleList[m]);
-      while(true){
-        if (returnValue->_arrSize == n){
-          return returnValue;
-        }
-        else if (returnValue->_nextList != 0){
-          returnValue = returnValue->_nextList;
-        }
-        else if (returnValue->_nextList == 0){
-          returnValue->_nextList = new MemRecycleList<T>(n);
-          return returnValue->_nextList;
-        }
-        else {
-          cerr << "MemMgr<T>::getMemRecycleList error" << endl;
-          return 0;
-        }
+      if (n < C::size) return &(_recycleList[n]);
+      size_t i = getListIdx(n) - C::size;
+      if (_bigOrder[i] == 0) _bigOrder[i] = ++_numBigUsed;
+      return &(_bigList[i]);
+   }
+   // The index of the list of size 'n' among all the lists, in the
+   // increasing order of their sizes: _recycleList[] then _bigList[]
+   size_t getListIdx(size_t n) const {
+      if (n < _flatEnd) return n;
+      assert(n >= C::flat);
+      if (getClassFloor(n) != n) {
+         assert(n == _maxArr);
+         return C::size + _numBigList - 1;
+      }
+      return _flatEnd + getClassIdx(n);
+   }
+   MemRecycleList<T>* getListAt(size_t i) {
+      return (i < C::size)? &(_recycleList[i]): &(_bigList[i - C::size]); }
+   size_t getNumLists() const { return C::size + _numBigList; }
+   // The size of the list that recycles arrays of size 'n'.
+   // From R_FLAT on, 'n' is rounded up to its geometric class, or to
+   // _maxArr in the top class if the rounded array does not fit in a
+   // block (so that getMem() and freeArr() agree on it).
+   size_t getListSize(size_t n) const {
+      if (n < C::flat) return n;
+      size_t c = getClassFloor(n);
+      if (c == n) return n;
+      size_t step = getClassStep(n);
+      return fitsBlock(c + step)? c + step: _maxArr;
+   }
+   // Geometric classes: [2^k, 2^(k+1)) is split into R_STEP classes
+   static constexpr size_t getClassStep(size_t n) {
+      return (size_t(1) << highBit(n)) / C::step; }
+   static constexpr size_t getClassFloor(size_t n) {
+      return n & ~(getClassStep(n) - 1); }
+   static constexpr size_t getClassIdx(size_t c) {
+      return (highBit(c) - highBit(C::flat)) * C::step
+             + (c - (size_t(1) << highBit(c))) / getClassStep(c);
+   }
+   static constexpr size_t highBit(size_t n) {
+      return sizeof(unsigned long) * 8 - 1 - __builtin_clzl(n); }
+   // (Re)create the lists of sizes >= R_SIZE for the current _blockSize:
+   // one per size in [R_SIZE, _flatEnd), one per geometric class up to
+   // the biggest array a block can hold (_maxArr), and one for _maxArr
+   // itself if it is not a class floor
+   void initBigList() {
+      delete [] _bigList;
+      delete [] _bigOrder;
+      _bigList = 0;
+      _bigOrder = 0;
+      _numBigList = _numBigUsed = 0;
+      _canaryBytes = (_hardened && threadMode() == MEM_THREAD_NONE &&
+                      !isShared())? SIZE_T: 0;
+      _hardAlign = isHardened()? getBlockAlign(): 0;
+      initBlockBytes();
+      for (size_t i = 0; i < C::size; ++i) {
+         _recycleList[i]._key = isHardened()? _secret: 0;
+         _recycleList[i]._link = (isHardened() && i != 0)? SIZE_T: 0;
+      }
+      size_t maxN = (_blockBytes >= S + SIZE_T)? getArraySize(_blockBytes): 0;
+      while (maxN > 0 && !fitsBlock(maxN)) --maxN;
+      _maxArr = maxN;
+      _flatEnd = (maxN + 1 < C::flat)? maxN + 1: C::flat;
+      if (_flatEnd < C::size) _flatEnd = C::size;
+      _numBigList = _flatEnd - C::size;
+      size_t numClass = 0;
+      if (maxN >= C::flat) {
+         numClass = getClassIdx(getClassFloor(maxN)) + 1;
+         _numBigList += numClass;
+         if (getClassFloor(maxN) != maxN) ++_numBigList;
+      }
+      _fitMap.assign((getNumLists() + 63) / 64, 0);
+      _fitNew.assign(getNumLists(), 0);
+      _classAlloc.assign(getNumLists(), 0);
+      _classFree.assign(getNumLists(), 0);
+      if (_numBigList == 0) return;
+      _bigList = new MemRecycleList<T>[_numBigList];
+      _bigOrder = new size_t[_numBigList]();
+      for (size_t i = 0; i < _numBigList; ++i) {
+         _bigList[i]._key = isHardened()? _secret: 0;
+         _bigList[i]._link = isHardened()? SIZE_T: 0;
+      }
+      size_t i = 0;
+      for (size_t n = C::size; n < _flatEnd; ++n)
+         _bigList[i++]._arrSize = n;
+      for (size_t c = C::flat; numClass > 0; c += getClassStep(c), --numClass)
+         _bigList[i++]._arrSize = c;
+      if (i < _numBigList)
+         _bigList[i++]._arrSize = maxN;
+   }
+   struct BigListOrder {
+      BigListOrder(const MemMgr* m) : _m(m) {}
+      bool operator() (size_t i, size_t j) const {
+         size_t ri = _m->_bigList[i]._arrSize % C::size;
+         size_t rj = _m->_bigList[j]._arrSize % C::size;
+         return (ri != rj)? ri < rj: _m->_bigOrder[i] < _m->_bigOrder[j];
+      }
+      const MemMgr* _m;
+   };
+   // The blocks and the lists, as print() shows them
+   void printBlocks() const {
+      cout << "* Block size            : " << blockSize() << " Bytes" << endl
+           << "* Number of blocks      : " << getNumBlocks() << endl
+           << "* Free mem in last block: " << _activeBlock->getRemainSize()
+           << endl
+           << "* Recycle list          : " << endl;
+      // Lists >= R_SIZE follow _recycleList[n % R_SIZE] in the order of
+      // their first use
+      vector<size_t> used;
+      for (size_t j = 0; j < _numBigList; ++j)
+         if (_bigOrder[j] != 0 && _bigList[j]._first != 0)
+            used.push_back(j);
+      sort(used.begin(), used.end(), BigListOrder(this));
+      int count = 0;
+      size_t i = 0, j = 0;
+      while (i < C::size) {
+         printList(&(_recycleList[i]), count);
+         for (; j < used.size() && _bigList[used[j]]._arrSize % C::size
+                                   == i; ++j)
+            printList(&(_bigList[used[j]]), count);
+         ++i;
+      }
+      cout << endl;
+      if (_store != MEM_STORE_NEW) {
+         cout << "* Block store           : "
+              << ((_store == MEM_STORE_MMAP)? "mmap": "huge pages");
+         if (_store == MEM_STORE_HUGE)
+            cout << " (" << _numFallback << " fallbacks)";
+         cout << endl;
+      }
+      if (_objAlign != SIZE_T || _noStraddle) {
+         cout << "* Object alignment      : " << _objAlign << " Bytes";
+         if (_noStraddle) cout << ", no straddling of " << MEM_LINE;
+         cout << endl;
+      }
+      if (isRelease())
+         cout << "* Spare blocks          : " << _numSpare << " ("
+              << _numReleased << " released)" << endl;
+      if (isHardened())
+         cout << "* Hardened              : " << _numDoubleFree
+              << " double frees, " << _numOverflow << " overflows, "
+              << _numBadLink << " bad links, " << _numBadFree
+              << " bad frees" << endl;
+      if (isFit())
+         cout << "* Split / coalesce      : " << _numSplit << " splits ("
+              << _splitBytes << " Bytes), " << _numMerge << " merges ("
+              << _mergeBytes << " Bytes)" << endl;
+      if (_largeObj || _spans != 0)
+         cout << "* Large spans           : " << _numSpans << " ("
+              << _spanBytes << " Bytes)" << endl;
+      if (threadMode() == MEM_THREAD_CACHE) {
+         size_t nCaches = 0, nCached = 0, nRemote = 0, nPending = 0;
+         for (const MemThreadCache<T>* c = _caches; c != 0; c = c->_next) {
+            ++nCaches;
+            for (int j = 0; j < TC_SIZE; ++j)
+               nCached += c->_recycleList[j].numElm();
+            nRemote += c->_numRemote;
+         }
+         nPending = _numPending;
+         cout << "* Thread caches         : " << nCaches << " (" << nCached
+              << " recycled, " << nRemote << " remote frees)" << endl
+              << "* Pending array frees   : " << nPending << endl;
+      }
+   }
+   // The counters, as printStats() shows them
+   void printCounters() const {
+      const MemStat& st = _stat;
+      double sec = chrono::duration<double>(
+                      chrono::steady_clock::now() - _statStart).count();
+      size_t numGet = st._numHit + st._numBump + st._numSplit;
+      streamsize prec = cout.precision();
+      cout << fixed << setprecision(2)
+           << "* Allocations           : " << st._numAlloc << " ("
+           << st._numHit << " recycled, " << st._numBump << " carved, "
+           << st._numSplit << " split, " << st._numLarge << " large)" << endl
+           << "* Recycle hit rate      : "
+           << (numGet? 100.0 * st._numHit / numGet: 0.0) << "%" << endl
+           << "* Frees                 : " << st._numFree << " ("
+           << st._numLargeFree << " large)" << endl
+           << "* Block switches        : " << st._numSwitch << endl
+           << "* Block tails           : " << st._tailBytes
+           << " Bytes recycled, " << st._tailWaste << " Bytes wasted" << endl
+           << "* Elapsed time          : " << setprecision(3) << sec
+           << " s" << endl
+           << "* Size classes          : allocs / frees (allocs per s)"
+           << endl;
+      for (size_t i = 0, nl = getNumLists(); i < nl; ++i) {
+         if (_classAlloc[i] == 0 && _classFree[i] == 0) continue;
+         size_t n = (i < C::size)? i: _bigList[i - C::size]._arrSize;
+         cout << "[" << setw(3) << right << n << "] = " << _classAlloc[i]
+              << " / " << _classFree[i] << " ("
+              << size_t(sec > 0? _classAlloc[i] / sec: 0) << ")" << endl;
+      }
+      cout.unsetf(ios::floatfield);
+      cout.precision(prec);
+   }
+   void printList(const MemRecycleList<T>* ll, int& count) const {
+      size_t s = ll->numElm();
+      if (s) {
+         cout << "[" << setw(3) << right << ll->_arrSize << "] = "
+              << setw(10) << left << s;
+         if (++count % 4 == 0) cout << endl;
       }
-
-      return 0;
    }
    // t is the #Bytes requested from new or new[]
    // Note: Make sure the returned memory is a multiple of SIZE_T
    T* getMem(size_t t) {
       T* ret = 0;
-      #ifdef MEM_DEBUG
-      cout << "Calling MemMgr::getMem...(" << t << ")" << endl;
-      #endif // MEM_DEBUG
-      // TODO ---
-      t = toSizeT(t);
-      try{
-        if (t > _blockSize){
-          cerr << "Requested memory (" << t << ") is greater than block size"
-               << "(" << _blockSize << "). " << "Exception raised...\n";
-          throw bad_alloc();
-        }
-      }
-      catch(string){
-        ;
-      }
-
-      size_t arraySize = getArraySize(t);
-      MemRecycleList<T>* recycleListWeWant = getMemRecycleList(arraySize);
-      if (recycleListWeWant->_first != 0){ //match
-        ret = recycleListWeWant->popFront();
-            #ifdef MEM_DEBUG
-            cout << "Recycled from _recycleList[" << arraySize << "]..." << ret << endl;
-            #endif // MEM_DEBUG
-      }
+      logEvent(MEM_LOG_GET_MEM, 0, t);
       // 1. Make sure to promote t to a multiple of SIZE_T
       // 2. Check if the requested memory is greater than the block size.
       //    If so, throw a "bad_alloc()" exception.
       //    cerr << "Requested memory (" << t << ") is greater than block size"
       //         << "(" << _blockSize << "). " << "Exception raised...\n";
+      if (isShared()) return getSharedMem(t);
+      t = toSizeT(t);
+      if (isLarge(t)) {
+         if (_largeObj && (ret = getLargeMem(t)) != 0) {
+            if (isStat()) { ++_stat._numAlloc; ++_stat._numLarge; }
+            logEvent(MEM_LOG_ACQUIRED, size_t(ret));
+            return ret;
+         }
+         throwLarge(t);
+      }
+      size_t n = getListSize(getArraySize(t));
+      t = getChunkSize(n);
+      countAlloc(n);
+      if (threadMode() != MEM_THREAD_CACHE) {
+         ret = getCentralMem(t, n);
+         if (isHardened()) armChunk(ret, t);
+      }
+      else if (n < TC_SIZE)
+         ret = getThreadMem(t, n);
+      else {
+         lock_guard<mutex> lock(_mutex);
+         ret = getCentralMem(t, n);
+      }
+      // 6. At the end, print out the acquired memory address
+      logEvent(MEM_LOG_ACQUIRED, size_t(ret));
+      return ret;
+   }
+   // Steps 3 to 5 of getMem() on _recycleList[] and _activeBlock
+   // t: #Bytes, already promoted; n: getArraySize(t)
+   T* getCentralMem(size_t t, size_t n) {
+      T* ret = 0;
       // 3. Check the _recycleList first...
       //    #ifdef MEM_DEBUG
       //    cout << "Recycled from _recycleList[" << n << "]..." << ret << endl;
       //    #endif // MEM_DEBUG
       //    => 'n' is the size of array
       //    => "ret" is the return address
-      else { // no match
-        size_t bytesLeft = _activeBlock->_end - _activeBlock->_ptr;
-        if (t > bytesLeft){ //not enough
-          size_t rn = (bytesLeft - SIZE_T)/S;
-          if (bytesLeft >= S){              //enough space for an array
-            (getMemRecycleList(rn))->pushFront((T*)(_activeBlock->_ptr));
-                #ifdef MEM_DEBUG
-                cout << "Recycling " << (T*)(_activeBlock->_ptr) << " to _recycleList[" << rn << "]\n";
-                #endif // MEM_DEBUG
-          }
-          //create new active block
-          MemBlock<T>* newActiveBlock = new MemBlock<T>(_activeBlock, _blockSize);
-          _activeBlock = newActiveBlock;
-          ret = (T*)(_activeBlock->_ptr);
-          _activeBlock->_ptr += t;
-              #ifdef MEM_DEBUG
-              cout << "New MemBlock... " << _activeBlock << endl;
-              #endif // MEM_DEBUG
-        }
-        else { // enough
-          ret = (T*)(_activeBlock->_ptr);
-          _activeBlock->_ptr += t;
-        }
+      MemRecycleList<T>* recycleListWeWant = getMemRecycleList(n);
+      if (recycleListWeWant->_first == 0 && _pendingFree != 0)
+         drainPendingFree();
+      if (recycleListWeWant->_first != 0 && _marks.empty() &&
+          (!isHardened() || checkList(recycleListWeWant))) { // match
+         ret = recycleListWeWant->popFront();
+         if (isStat()) ++_stat._numHit;
+         logEvent(MEM_LOG_RECYCLED, size_t(ret), n);
+         getLive(ret, t);
+         return ret;
+      }
+      if (isFit()) {
+         if ((ret = getFitMem(t, n)) != 0) return ret;
+         if (t > _activeBlock->getRemainSize() && _fitFreed >= blockSize()) {
+            coalesceLists(true);
+            return getCentralMem(t, n);
+         }
       }
       // If no match from recycle list...
       // 4. Get the memory from _activeBlock
@@ -457,31 +1789,559 @@ private:
       //    #ifdef MEM_DEBUG
       //    cout << "New MemBlock... " << _activeBlock << endl;
       //    #endif // MEM_DEBUG
-      // 6. At the end, print out the acquired memory address
-      //    #ifdef MEM_DEBUG
-      //    cout << "Memory acquired... " << ret << endl;
-      //    #endif // MEM_DEBUG
-          #ifdef MEM_DEBUG
-          cout << "Memory acquired... " << ret << endl;
-          #endif // MEM_DEBUG
+      if ((ret = carve(_activeBlock, t, n)) == 0) { // not enough
+         switchBlock();
+         ret = carve(_activeBlock, t, n);
+      }
+      if (isStat()) ++_stat._numBump;
+      getLive(ret, t);
       return ret;
    }
-   // Get the currently allocated number of MemBlock's
-   size_t getNumBlocks() const {
-      // TODO
+   // Recycle the remained memory of _activeBlock and switch to a spare
+   // block or a new one
+   void switchBlock() {
+      recycleRemain(_activeBlock);
+      if (_spareBlock != 0) {
+         MemBlock<T>* blk = _spareBlock;
+         _spareBlock = blk->_nextBlock;
+         --_numSpare;
+         blk->_nextBlock = _activeBlock;
+         _activeBlock = blk;
+      }
+      else
+         _activeBlock = newBlock(_activeBlock);
+      ++_numBlocks;
+      if (isStat()) ++_stat._numSwitch;
+      logEvent(MEM_LOG_NEW_BLOCK, size_t(_activeBlock));
+   }
+   // Recycle the remained memory of 'blk' to the biggest array index
+   // possible, and use it up
+   void recycleRemain(MemBlock<T>* blk) {
+      size_t bytesLeft = blk->getRemainSize(), recycled = 0;
+      if (bytesLeft >= S) {  // enough space for an array
+         // The biggest array, or else an object, placed as carve() does
+         size_t rn = 1;
+         char* p = placeChunk(blk->_ptr, rn, 0);
+         size_t skip = p - blk->_ptr;
+         if (bytesLeft < skip + getChunkSize(rn)) {
+            rn = 0;
+            p = placeChunk(blk->_ptr, rn, getChunkSize(rn));
+            skip = p - blk->_ptr;
+         }
+         if (bytesLeft >= skip + getChunkSize(rn)) {
+            if (rn != 0) rn = getFitSize(bytesLeft - skip);
+            if (isHardened()) MemBlock<T>::setFree(p, _hardAlign, true);
+            recycle((T*)p, rn);
+            recycled = getChunkSize(rn);
+            if (rn < TC_SIZE) ++_numCentral[rn];
+            logEvent(MEM_LOG_RECYCLING, size_t(p), rn);
+         }
+      }
+      if (isStat()) {
+         _stat._tailBytes += recycled;
+         _stat._tailWaste += bytesLeft - recycled;
+      }
+      blk->_ptr = blk->_end;
+   }
+   // The event log (see memLog.h), on in MEM_DEBUG builds
+   bool isLogged() const { return memLog().isOn(); }
+   void logEvent(MemLogEvent e, size_t p, size_t n = 0) const {
+      MemLog& l = memLog();
+      if (l.isOn()) l.put(e, p, n);
+   }
+   // Whether 't' Bytes, rounded up to SIZE_T, make a large object
+   bool isLarge(size_t t) const {
+      t = toSizeT(t);
+      return t > _blockBytes || !fitsBlock(getArraySize(t));
+   }
+   void throwLarge(size_t t) const {
+      #ifdef MEM_DEBUG
+      memLog().drain(cout);  // the events so far go first
+      #endif // MEM_DEBUG
+      cerr << "Requested memory (" << t << ") is greater than block size"
+           << "(" << _blockBytes << "). " << "Exception raised...\n";
+      throw bad_alloc();
+   }
+   // Carve 't' Bytes for list size 'n' from 'blk', placed by placeChunk();
+   // 0 if not enough
+   T* carve(MemBlock<T>* blk, size_t t, size_t n) const {
+      char* p = placeChunk(blk->_ptr, n, t);
+      if (size_t(p - blk->_ptr) + t > blk->getRemainSize()) return 0;
+      blk->_ptr = p + t;
+      return (T*)p;
+   }
+   // Where a chunk of 't' Bytes for list size 'n' goes at or after 'p':
+   // an object at _objAlign, moved to the next MEM_LINE if it would
+   // straddle one in no-straddle mode; an array with its elements (after
+   // the array size) at _objAlign.
+   // Each list keeps chunks placed alike, as its chunk size is a multiple
+   // of _objAlign.
+   char* placeChunk(char* p, size_t n, size_t t) const {
+      return p + getSkip(size_t(p), n, t); }
+   // #Bytes placeChunk() skips from address 'p'; the same from any 'p'
+   // equal modulo _objAlign and MEM_LINE (e.g. a page offset)
+   size_t getSkip(size_t p, size_t n, size_t t) const {
+      size_t a = _objAlign - 1;
+      if (n != 0) return ((p + SIZE_T + a) & ~a) - SIZE_T - p;
+      size_t q = (p + a) & ~a;
+      if (_noStraddle) {
+         size_t off = q % MEM_LINE;
+         if (off != 0 && (t > MEM_LINE || off + t > MEM_LINE))
+            q += MEM_LINE - off;
+      }
+      return q - p;
+   }
+   // Whether the chunks of list size 'n' fit in a block wherever the
+   // active block is at
+   bool fitsBlock(size_t n) const {
+      size_t a = (_noStraddle && MEM_LINE > _objAlign)? MEM_LINE: _objAlign;
+      return getChunkSize(n) + a - SIZE_T <= _blockBytes;
+   }
+
+   // Push 'p' to the central recycle list of size 'n'
+   void recycle(T* p, size_t n) {
+      if (!_marks.empty()) touchList(n);
+      getMemRecycleList(n)->pushFront(p);
+      if (isFit()) {
+         size_t i = getListIdx(n), w = 8 * SIZE_T;
+         _fitMap[i / w] |= size_t(1) << (i % w);
+         _fitFreed += getChunkSize(n);
+         ++_fitNew[i];
+      }
+   }
+   // Push the chain of 'k' elements from 'first' to 'last' to the central
+   // recycle list of size 'n'
+   void recycleChain(T* first, T* last, size_t k, size_t n) {
+      if (!_marks.empty()) touchList(n);
+      getMemRecycleList(n)->pushChain(first, last, k);
+      if (isFit()) {
+         size_t i = getListIdx(n), w = 8 * SIZE_T;
+         _fitMap[i / w] |= size_t(1) << (i % w);
+         _fitFreed += k * getChunkSize(n);
+         _fitNew[i] += k;
+      }
+   }
+   // #Bytes of a chunk in the list of size 'n'; a multiple of _objAlign
+   size_t getChunkSize(size_t n) const {
+      size_t t = ((n == 0)? S: n * S + SIZE_T) + _canaryBytes;
+      return (t + _objAlign - 1) & ~(_objAlign - 1);
+   }
+   // The biggest list size whose chunks fit in 'b' (>= S) Bytes
+   size_t getFitSize(size_t b) const {
+      size_t n = (b - SIZE_T) / S;
+      if (n > _maxArr) n = _maxArr;
+      while (n > 0 && getChunkSize(n) > b) --n;
+      return (n >= C::flat)? getClassFloor(n): n;
+   }
+
+   // Split/coalesce (MEM_THREAD_NONE only)
+   //
+   bool isFit() const {
+      return _fit && threadMode() == MEM_THREAD_NONE && _objAlign == SIZE_T &&
+             !_noStraddle && !_hardened;
+   }
+   // Get 't' Bytes for list size 'n' from the smallest non-empty list
+   // bigger than it; the rest of the chunk is recycled if it can hold
+   // an object. Return 0 if there is none.
+   T* getFitMem(size_t t, size_t n) {
+      const size_t w = 8 * SIZE_T;
+      size_t i = getListIdx(n) + 1;
+      for (size_t k = i / w; k < _fitMap.size(); ++k) {
+         size_t bits = _fitMap[k];
+         if (k == i / w) bits &= ~size_t(0) << (i % w);
+         for (; bits != 0; bits &= bits - 1) {
+            size_t j = k * w + __builtin_ctzl(bits);
+            MemRecycleList<T>* l = getListAt(j);
+            if (l->_first == 0) {  // emptied since marked
+               _fitMap[k] &= ~(size_t(1) << (j % w));
+               continue;
+            }
+            T* ret = l->popFront();
+            size_t c = getChunkSize(l->_arrSize);
+            assert(c >= t);
+            if (c - t >= S)
+               recycle((T*)((char*)ret + t), getFitSize(c - t));
+            ++_numSplit; _splitBytes += t;
+            if (isStat()) ++_stat._numSplit;
+            logEvent(MEM_LOG_SPLIT, size_t(ret), l->_arrSize);
+            getLive(ret, t);
+            return ret;
+         }
+      }
+      return 0;
+   }
+
+   // Large objects: map a span of its own for 't' bytes
+   // The span is page-aligned, so the chunk after its header is placed
+   // as in a block
+   T* getLargeMem(size_t t) {
+      size_t n = (t == toSizeT(S))? 0: 1;
+      size_t h = MemSpan<T>::hdrSize + getSkip(MemSpan<T>::hdrSize, n, t);
+      MemSpan<T>* span = MemSpan<T>::map(t, h);
+      if (span == 0) return 0;
+      logEvent(MEM_LOG_NEW_SPAN, size_t(span), span->_size);
+      unique_lock<mutex> lock(_mutex, defer_lock);
+      if (threadMode() == MEM_THREAD_CACHE) lock.lock();
+      span->_next = _spans;
+      if (_spans != 0) _spans->_prev = span;
+      _spans = span;
+      span->_seq = ++_spanSeq;
+      span->_tag = size_t(span) ^ ~_secret;
+      ++_numSpans; _spanBytes += span->_size;
+      return span->getObj();
+   }
+   void freeLargeMem(T* p) {
+      if (isHardened() && !isSpan(p)) {
+         ++_numBadFree;
+         reportBad("a free of no span", p);
+         return;
+      }
+      MemSpan<T>* span = MemSpan<T>::getSpan(p);
+      logEvent(MEM_LOG_RELEASE_SPAN, size_t(span));
+      {
+         unique_lock<mutex> lock(_mutex, defer_lock);
+         if (threadMode() == MEM_THREAD_CACHE) lock.lock();
+         if (span->_prev != 0) span->_prev->_next = span->_next;
+         else _spans = span->_next;
+         if (span->_next != 0) span->_next->_prev = span->_prev;
+         --_numSpans; _spanBytes -= span->_size;
+      }
+      if (isStat()) { ++_stat._numFree; ++_stat._numLargeFree; }
+      MemSpan<T>::unmap(span);
+   }
+
+   // Live counts (MEM_THREAD_NONE only)
+   //
+   // The blocks count their objects if they can be found from them
+   // Statistics (see MemStat)
+   bool isStat() const {
+      return P::stats && threadMode() == MEM_THREAD_NONE; }
+   // 'k' arrays of list size 'n' have been handed out, or recycled
+   void countAlloc(size_t n, size_t k = 1) {
+      if (!isStat()) return;
+      _stat._numAlloc += k;
+      _classAlloc[getListIdx(n)] += k;
+   }
+   void countFree(size_t n, size_t k = 1) {
+      if (!isStat()) return;
+      _stat._numFree += k;
+      _classFree[getListIdx(n)] += k;
+   }
+   bool isCounted() const { return isRelease() || isFit(); }
+   // 'k' objects of 't' Bytes from 'p' on have just been handed out
+   void getLive(T* p, size_t t, size_t k = 1) {
+      if (threadMode() != MEM_THREAD_NONE) return;
+      if (P::stats && (_liveBytes += k * t) > _maxLive)
+         _maxLive = _liveBytes;
+      if (isCounted())
+         MemBlock<T>::getBlock(p, getBlockAlign())->addLive(t, k);
+   }
+   // 'p' of 't' Bytes has just been recycled; release the empty blocks
+   // if enough blocks have been emptied since the last time
+   void putLive(T* p, size_t t) {
+      if (P::stats) _liveBytes -= (_liveBytes > t)? t: _liveBytes;
+      if (!isCounted()) return;
+      MemBlock<T>* blk = MemBlock<T>::getBlock(p, getBlockAlign());
+      blk->removeLive(t);
+      if (isRelease() && blk->_numLive == 0 && blk != _activeBlock &&
+          ++_numEmpty >= MEM_RELEASE_BATCH)
+         releaseEmptyBlocks();
+   }
+
+   // Record the size of the list of size 'n' before it first grows since
+   // the last mark
+   void touchList(size_t n) {
+      MemMark& k = _marks.back();
+      size_t i = getListIdx(n), w = 8 * SIZE_T;
+      if (k._touched[i / w] & (size_t(1) << (i % w))) return;
+      k._touched[i / w] |= size_t(1) << (i % w);
+      k._numElm.push_back(make_pair(i, getListAt(i)->_numElm));
+   }
+   // Whether 'p' is in one of the sorted ranges 'r' (see rollback())
+   static bool isCarvedIn(char* p, const vector<pair<char*, char*> >& r) {
+      size_t i = upper_bound(r.begin(), r.end(), make_pair(p, p),
+                             carvedBefore) - r.begin();
+      return i != 0 && p < r[i - 1].second;
+   }
+   static bool carvedBefore(const pair<char*, char*>& x,
+                            const pair<char*, char*>& y) {
+      return x.first < y.first; }
+
+   // Shared mode (see setShared())
+   //
+   bool isShared() const {
+      return _arena != 0 && threadMode() == MEM_THREAD_NONE; }
+   // 't' Bytes from new or new[], from the arena
+   T* getSharedMem(size_t t) {
+      T* ret = 0;
+      if (t == S) {
+         checkShared(sizeof(Raw));
+         ret = (T*)(_arena->alloc(sizeof(Raw)));
+         ++_numSharedObj;
+         countShared(sizeof(Raw), true);
+      }
+      else {
+         t = getSharedArrSize(getArraySize(toSizeT(t))) * sizeof(Raw)
+             + SIZE_T;
+         checkShared(t);
+         ret = (T*)(_arena->allocArr(t));
+         ++_numSharedArr;
+         countShared(t, true);
+      }
+      logEvent(MEM_LOG_ACQUIRED, size_t(ret));
+      return ret;
+   }
+   // The #Raw elements that hold 'n' T's
+   size_t getSharedArrSize(size_t n) const {
+      return (n * S + sizeof(Raw) - 1) / sizeof(Raw); }
+   // The arena maps large objects for all its types; only do so for T
+   // if its own large-object mode is on
+   void checkShared(size_t t) const {
+      if (!_largeObj && _arena->isLarge(t)) _arena->throwLarge(toSizeT(t));
+   }
+   void countShared(size_t t, bool get) {
+      if (!P::stats) return;
+      if (!get) _liveBytes -= (_liveBytes > t)? t: _liveBytes;
+      else if ((_liveBytes += t) > _maxLive) _maxLive = _liveBytes;
+   }
+
+   // Empty-block release (MEM_THREAD_NONE only)
+   //
+   bool isRelease() const {
+      return _release && threadMode() == MEM_THREAD_NONE; }
+   // Remove the elements of the blocks to be released from 'l'
+   void purgeEmpty(MemRecycleList<T>* l) {
+      size_t a = getBlockAlign();
+      T* prev = 0;
+      for (T* p = l->_first; p != 0; ) {
+         T* next = l->getNext(p);
+         if (MemBlock<T>::getBlock(p, a)->_empty) {
+            if (prev == 0) l->_first = next;
+            else l->setNext(prev, next);
+            --(l->_numElm);
+         }
+         else
+            prev = p;
+         p = next;
+      }
+   }
+
+   // Create a block of _blockBytes in front of 'next'; an empty one in
+   // shared mode, as the arena holds the memory
+   MemBlock<T>* newBlock(MemBlock<T>* next) {
+      if (isShared()) return MemBlock<T>::create(next, 0);
+      MemBlock<T>* blk = MemBlock<T>::create(next, _blockBytes,
+                            getBlockAlign(), _store, isHardened());
+      if (blk->_fallback) ++_numFallback;
+      return blk;
+   }
+   // In MEM_THREAD_CACHE mode, free() finds the owner of an object from
+   // its block, and with empty-block release on, the block to count it
+   // off; so the blocks are aligned to a power of 2. Hardened mode finds
+   // the free map the same way. The header (and free map) are inside the
+   // window, which is blockSize() rounded up to a power of 2 (and twice
+   // the header at least). 0 otherwise.
+   size_t getBlockAlign() const {
+      if (threadMode() != MEM_THREAD_CACHE && !isCounted() && !isHardened())
+         return 0;
+      size_t a = SIZE_T;
+      while (a < blockSize() || a < 2 * MemBlock<T>::hdrSize()) a <<= 1;
+      return a;
+   }
+   // The storage of each block: blockSize(), or in the aligned modes what
+   // the window of getBlockAlign() leaves after the header and free map,
+   // if less; e.g. a little less than 64 KBytes for 65536, rather than
+   // a 128-KByte window
+   void initBlockBytes() {
+      size_t a = getBlockAlign();
+      _blockBytes = blockSize();
+      if (a == 0) return;
+      size_t b = a - MemBlock<T>::hdrSize();
+      if (isHardened()) b -= MemBlock<T>::freeMapBytes(b);
+      b = downtoSizeT(b);
+      if (b < _blockBytes) _blockBytes = b;
+   }
+
+   // Hardened mode (MEM_THREAD_NONE only)
+   //
+   bool isHardened() const { return _canaryBytes != 0; }
+   // Mark the chunk 'p' of 't' Bytes, canary included, in use
+   void armChunk(T* p, size_t t) {
+      MemBlock<T>::setFree(p, _hardAlign, false);
+      *((size_t*)((char*)p + t - _canaryBytes)) = size_t(p) ^ _secret;
+   }
+   // Whether the chunk 'p' of list size 'n' can be recycled, and if so
+   // mark it free: not if it is free already. Its canary is checked
+   // either way.
+   bool checkFree(T* p, size_t n) {
+      if (MemBlock<T>::setFree(p, _hardAlign, true)) {
+         ++_numDoubleFree;
+         reportBad("a double free", p);
+         return false;
+      }
+      char* c = (char*)p + getChunkSize(n) - _canaryBytes;
+      if (*((size_t*)c) != (size_t(p) ^ _secret)) {
+         ++_numOverflow;
+         reportBad("an overflow", p);
+      }
+      return true;
+   }
+   // Whether the array 'p' is a span, or a chunk not free already; only
+   // then can its size be read
+   bool checkArr(T* p) {
+      if (isSpan(p) || !MemBlock<T>::isFree(p, _hardAlign)) return true;
+      ++_numDoubleFree;
+      reportBad("a double free", p);
+      return false;
+   }
+   // Whether 'p' is the object of a span, by the tag in its header.
+   // Before a chunk in a block is the block, so the tag can be read; a
+   // canary or link there differs from it, not being XORed with ~_secret.
+   // A span freed already is unmapped, so it cannot be told.
+   bool isSpan(T* p) const {
+      MemSpan<T>* span = MemSpan<T>::getSpan(p);
+      return span->_tag == (size_t(span) ^ ~_secret);
+   }
+   // Whether the first element of 'l' links to an aligned one, as the
+   // key makes an overwritten link misaligned; if not, the list is
+   // dropped (and its elements leaked)
+   bool checkList(MemRecycleList<T>* l) {
+      if ((size_t(l->getNext(l->_first)) & SIZE_T_1) == 0) return true;
+      ++_numBadLink;
+      reportBad("a bad link", l->_first);
+      l->clear();
+      return false;
+   }
+   // The address is given in MEM_DEBUG builds only, as in the event log,
+   // so that the other builds report the same from run to run
+   void reportBad(const char* what, const void* p) const {
+      #ifdef MEM_DEBUG
+      memLog().drain(cout);
+      cerr << "Error: MemMgr found " << what << " at " << p;
+      #else
+      cerr << "Error: MemMgr found " << what;
+      #endif // MEM_DEBUG
+      cerr << "!!" << endl;
+   }
+
+   // Thread cache functions (MEM_THREAD_CACHE mode)
+   //
+   // Get the cache of the calling thread, binding one at the first call
+   MemThreadCache<T>* getThreadCache() {
+      MemThreadCache<T>* c = _tlsCaches._head;
+      if (c != 0 && c->_mgr == this) return c;
+      for (; c != 0; c = c->_tlsNext)
+         if (c->_mgr == this) return c;
+      // Adopt a cache released by an exited thread, or create a new one
+      lock_guard<mutex> lock(_mutex);
+      for (c = _caches; c != 0; c = c->_next)
+         if (!c->_inUse) break;
+      if (c == 0) {
+         c = new MemThreadCache<T>(this);
+         c->_next = _caches;
+         _caches = c;
+      }
+      c->_inUse = true;
+      c->_tlsNext = _tlsCaches._head;
+      _tlsCaches._head = c;
+      return c;
+   }
+   // Called when the thread of 'c' exits; its recycled elements go back
+   // to the central lists, while its block is kept for the next adopter
+   void releaseThreadCache(MemThreadCache<T>* c) {
+      lock_guard<mutex> lock(_mutex);
+      c->drainRemote();
+      for (int i = 0; i < TC_SIZE; ++i)
+         _numCentral[i] +=
+            _recycleList[i].takeFront(&(c->_recycleList[i]), size_t(-1));
+      c->_inUse = false;
+   }
+   // t: #Bytes, already promoted; n: getArraySize(t) < TC_SIZE
+   T* getThreadMem(size_t t, size_t n) {
+      MemThreadCache<T>* c = getThreadCache();
+      MemRecycleList<T>* l = &(c->_recycleList[n]);
+      if (l->_first == 0) c->drainRemote();
+      if (l->_first == 0 && _numCentral[n] != 0) {  // refill in a batch
+         lock_guard<mutex> lock(_mutex);
+         _numCentral[n] -= l->takeFront(&(_recycleList[n]), TC_BATCH);
+      }
+      if (l->_first != 0) {
+         logEvent(MEM_LOG_THREAD_RECYCLED, size_t(l->_first), n);
+         return l->popFront();
+      }
+      T* ret = (c->_block == 0)? 0: carve(c->_block, t, n);
+      if (ret == 0) {
+         lock_guard<mutex> lock(_mutex);
+         if (c->_block != 0) recycleRemain(c->_block);
+         c->_block = _threadBlock = newBlock(_threadBlock);
+         c->_block->_owner = c;
+         ++_numBlocks;
+         logEvent(MEM_LOG_THREAD_BLOCK, size_t(c->_block));
+         ret = carve(c->_block, t, n);
+      }
+      return ret;
+   }
+   // Recycle 'p' of array size n < TC_SIZE to the cache owning its block,
+   // lock-free if that is another thread's. For the calling thread's own
+   // cache, flush a batch to the central lists if it grows too long.
+   void putThreadMem(T* p, size_t n) {
+      MemThreadCache<T>* c = getThreadCache();
+      MemThreadCache<T>* owner =
+         MemBlock<T>::getBlock(p, getBlockAlign())->_owner;
+      // (a cache unbound from its thread would only strand it)
+      if (owner != 0 && owner != c &&
+          owner->_inUse.load(memory_order_relaxed)) {
+         owner->pushRemote(p, n);
+         return;
+      }
+      c->_recycleList[n].pushFront(p);
+      if (c->_recycleList[n].numElm() > 2 * TC_BATCH) {
+         lock_guard<mutex> lock(_mutex);
+         _numCentral[n] +=
+            _recycleList[n].takeFront(&(c->_recycleList[n]), TC_BATCH);
+      }
+   }
+
+   // Arrays of size n >= TC_SIZE are freed lock-free to _pendingFree,
+   // with 'n' kept in the 2nd word (such arrays are >= 2 words).
+   // Drained to _recycleList[] under the lock when getMem() misses.
+   void pushPendingFree(T* p, size_t n) {
+      ((size_t*)p)[1] = n;
+      _numPending.fetch_add(1, memory_order_relaxed);
+      T* first = _pendingFree.load(memory_order_relaxed);
+      do { *((size_t*)p) = (size_t)first; }
+      while (!_pendingFree.compare_exchange_weak(first, p,
+                memory_order_release, memory_order_relaxed));
+   }
+   void drainPendingFree() {
+      T* p = _pendingFree.exchange(0, memory_order_acquire);
       size_t count = 0;
-      MemBlock<T>* iter;
-      iter = _activeBlock;
-      while (true){
-        count += 1;
-        iter = iter->_nextBlock;
-        if (iter == 0){
-          break;
-        }
+      for (; p != 0; ++count) {
+         T* next = (T*)(*((size_t*)p));
+         getMemRecycleList(((size_t*)p)[1])->pushFront(p);
+         p = next;
       }
-      return count;
+      _numPending.fetch_sub(count, memory_order_relaxed);
    }
 
 };
 
+template <class T, size_t BlockSize, class... Policies>
+thread_local MemThreadCacheList<T>
+MemMgr<T, BlockSize, Policies...>::_tlsCaches;
+
+// The arena for the types of raw storage R (see MemMgr::setShared());
+// it maps large objects, and is never deleted, so that objects freed at
+// exit still find it
+template <class R>
+MemMgr<R>* memArena()
+{
+   static MemMgr<R>* a = [] {
+      MemMgr<R>* m = new MemMgr<R>;
+      m->setLargeObj(true);
+      return m;
+   }();
+   return a;
+}
+
 #endif // MEM_MGR_H
@@ -10,7 +10,12 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
 #include <cassert>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include "memMgr.h"
 
 using namespace std;
@@ -40,6 +45,45 @@ private:
 };
 
 
+#define MT_NOT_LIVE size_t(-1)
+
+// The live positions of a list of MemTest, packed densely so that
+// a random live one is picked in O(1). A position is removed by moving
+// the last one into its place.
+//
+class MemTestLive
+{
+public:
+   MemTestLive() {}
+   ~MemTestLive() {}
+
+   void clear() { _live.clear(); _where.clear(); }
+   void add(size_t i) {
+      if (i >= _where.size()) _where.resize(i + 1, MT_NOT_LIVE);
+      _where[i] = _live.size();
+      _live.push_back(i);
+   }
+   void remove(size_t i) {
+      if (i >= _where.size() || _where[i] == MT_NOT_LIVE) return;
+      size_t last = _live.back();
+      _live[_where[i]] = last;
+      _where[last] = _where[i];
+      _live.pop_back();
+      _where[i] = MT_NOT_LIVE;
+   }
+   // Remove the positions >= n
+   void truncate(size_t n) {
+      for (size_t i = n; i < _where.size(); ++i) remove(i);
+      if (n < _where.size()) _where.resize(n);
+   }
+   const vector<size_t>& get() const { return _live; }
+
+private:
+   vector<size_t>  _live;    // the live positions, in no order
+   vector<size_t>  _where;   // where each position is in _live[]
+};
+
+
 class MemTest
 {
 public:
@@ -47,43 +91,319 @@ public:
    ~MemTest() {}
 
    void reset(size_t b = 0) {
-      _objList.clear(); _arrList.clear();
+      #ifdef MEM_MGR_H
+      // The shared arena is not reset with MemTestObj's manager
+      if (MemTestObj::memIsShared()) deleteAll();
+      #endif // MEM_MGR_H
+      _objList.clear(); _arrList.clear(); _marks.clear();
+      _objLive.clear(); _arrLive.clear();
       #ifdef MEM_MGR_H
       MemTestObj::memReset(b);
       #endif // MEM_MGR_H
+      drainLog();
+   }
+   // Map objects bigger than the block size on their own (see MTReset)
+   void setLargeObj(bool l) {
+      #ifdef MEM_MGR_H
+      MemTestObj::memSetLargeObj(l);
+      #endif // MEM_MGR_H
+   }
+   // Release the blocks emptied by deletions (see MTReset)
+   void setReleaseEmpty(bool r) {
+      #ifdef MEM_MGR_H
+      MemTestObj::memSetReleaseEmpty(r);
+      #endif // MEM_MGR_H
+   }
+   // Split and coalesce the recycled chunks (see MTReset)
+   void setFit(bool f) {
+      #ifdef MEM_MGR_H
+      MemTestObj::memSetFit(f);
+      #endif // MEM_MGR_H
+   }
+   // Align the objects to 'a' Bytes, 0 for natural (see MTReset)
+   void setAlign(size_t a) {
+      #ifdef MEM_MGR_H
+      MemTestObj::memSetAlign(a);
+      #endif // MEM_MGR_H
+   }
+   // Keep each object within a cache line (see MTReset)
+   void setNoStraddle(bool s) {
+      #ifdef MEM_MGR_H
+      MemTestObj::memSetNoStraddle(s);
+      #endif // MEM_MGR_H
+   }
+   // Share the arena of the types of the same size (see MTReset)
+   void setShared(bool s) {
+      #ifdef MEM_MGR_H
+      if (MemTestObj::memIsShared() != s) deleteAll();
+      MemTestObj::memSetShared(s);
+      #endif // MEM_MGR_H
+   }
+   // Check every free for double frees and overflows (see MTReset)
+   void setHardened(bool h) {
+      #ifdef MEM_MGR_H
+      MemTestObj::memSetHardened(h);
+      #endif // MEM_MGR_H
+   }
+   bool isHardened() const {
+      #ifdef MEM_MGR_H
+      return MemTestObj::memGetHardened();
+      #else
+      return false;
+      #endif // MEM_MGR_H
+   }
+   // Run the memory manager single-threaded or with thread caches
+   // (see MTReset)
+   void setThreadMode(MemThreadMode m) {
+      #ifdef MEM_MGR_H
+      if (MemTestObj::memGetThreadMode() != m)
+         MemTestObj::memSetThreadMode(m);
+      #endif // MEM_MGR_H
+   }
+   // Where the blocks get their memory (see MTReset)
+   void setStore(MemStore s) {
+      #ifdef MEM_MGR_H
+      MemTestObj::memSetStore(s);
+      #endif // MEM_MGR_H
    }
    size_t getObjListSize() const { return _objList.size(); }
    size_t getArrListSize() const { return _arrList.size(); }
+   // The positions of the live objects (arrays) in the lists, in no order;
+   // MTDelete -Random picks from them
+   const vector<size_t>& getLiveObjs() const { return _objLive.get(); }
+   const vector<size_t>& getLiveArrs() const { return _arrLive.get(); }
+   // #Bytes of the blocks and large spans of the memory manager
+   size_t getFootprint() const {
+      #ifdef MEM_MGR_H
+      return MemTestObj::memFootprint();
+      #else
+      return 0;
+      #endif // MEM_MGR_H
+   }
+
+   // Mark the lists and the memory manager; return the mark (see MTMark)
+   size_t mark() {
+      _marks.push_back(make_pair(_objList.size(), _arrList.size()));
+      #ifdef MEM_MGR_H
+      MemTestObj::memMark();
+      #endif // MEM_MGR_H
+      drainLog();
+      return _marks.size() - 1;
+   }
+   // Drop the objects and arrays allocated since mark 'm' at once,
+   // without deleting them one by one (see MTRollback)
+   void rollback(size_t m) {
+      assert(m < _marks.size());
+      #ifdef MEM_MGR_H
+      MemTestObj::memRollback(m);
+      #else
+      deleteObjs(_marks[m].first, _objList.size());
+      deleteArrs(_marks[m].second, _arrList.size());
+      #endif // MEM_MGR_H
+      _objList.resize(_marks[m].first);
+      _arrList.resize(_marks[m].second);
+      _objLive.truncate(_marks[m].first);
+      _arrLive.truncate(_marks[m].second);
+      _marks.resize(m);
+      drainLog();
+   }
+   size_t getNumMarks() const { return _marks.size(); }
+
+   // Trace the memory manager to the file 'name', or stop if it is empty;
+   // return false if the file cannot be written (see MTTrace)
+   bool setTrace(const string& name) {
+      #ifdef MEM_MGR_H
+      return MemTestObj::memSetTrace(name);
+      #else
+      return name.empty();
+      #endif // MEM_MGR_H
+   }
+   // The trace file and its #records so far; ("", 0) if not tracing
+   string getTraceName() const {
+      #ifdef MEM_MGR_H
+      const MemTracer* t = MemTestObj::memGetTrace();
+      if (t != 0) return t->getName();
+      #endif // MEM_MGR_H
+      return "";
+   }
+   size_t getTraceRecs() const {
+      #ifdef MEM_MGR_H
+      const MemTracer* t = MemTestObj::memGetTrace();
+      if (t != 0) return t->getNumRecs();
+      #endif // MEM_MGR_H
+      return 0;
+   }
+
+   // The event log of the memory managers (see MTLog and memLog.h)
+   void setLog(bool on) {
+      #ifdef MEM_MGR_H
+      memLog().setOn(on);
+      #endif // MEM_MGR_H
+   }
+   bool isLogOn() const {
+      #ifdef MEM_MGR_H
+      return memLog().isOn();
+      #else
+      return false;
+      #endif // MEM_MGR_H
+   }
+   void clearLog() {
+      #ifdef MEM_MGR_H
+      memLog().clear();
+      #endif // MEM_MGR_H
+   }
+   // Print the last 'last' (0: all) events in 'mask' (bit e for event e);
+   // return the #events overwritten before them
+   size_t printLog(size_t last, uint32_t mask) const {
+      #ifdef MEM_MGR_H
+      const MemLog& l = memLog();
+      l.print(cout, last, mask);
+      return l.getNumPut() - l.getNumKept();
+      #else
+      return 0;
+      #endif // MEM_MGR_H
+   }
+
+   // Print the allocation statistics, and zero them if 'clear' (see MTStat)
+   void printStats(bool clear) const {
+      #ifdef MEM_MGR_H
+      MemTestObj::memPrintStats();
+      if (clear) MemTestObj::memClearStats();
+      #endif // MEM_MGR_H
+   }
+   bool canMark() const {
+      #ifdef MEM_MGR_H
+      return MemTestObj::memCanMark();
+      #else
+      return true;
+      #endif // MEM_MGR_H
+   }
 
    // Allocate "n" number of MemTestObj elements
    void newObjs(size_t n) {
       // TODO
+      if (n == 0) return;
+      #ifdef MEM_MGR_H
+      // in one batch from the memory manager
+      size_t i = _objList.size();
+      _objList.resize(i + n);
+      try { MemTestObj::memAllocBatch(n, &(_objList[i])); }
+      catch (bad_alloc&) { _objList.resize(i); throw; }
+      for (; i < _objList.size(); ++i) {
+         new (_objList[i]) MemTestObj;
+         _objLive.add(i);
+      }
+      #else
       for (size_t i = 0; i < n; i++){
         MemTestObj* newObj = new MemTestObj;
         _objList.push_back(newObj);
+        _objLive.add(_objList.size() - 1);
       }
+      #endif // MEM_MGR_H
+      drainLog();
    }
    // Allocate "n" number of MemTestObj arrays with size "s"
    void newArrs(size_t n, size_t s) {
       // TODO
+      if (n == 0) return;
       for (size_t i = 0; i < n; i++){
         MemTestObj* newObj = new MemTestObj[s];
         _arrList.push_back(newObj);
+        _arrLive.add(_arrList.size() - 1);
       }
+      drainLog();
    }
    // Delete the object with position idx in _objList[]
-   void deleteObj(size_t idx) {
+   // With 'keep', it stays in the list, so that deleting it again is a
+   // double free; hardened mode only (see MTReset -Hardened)
+   void deleteObj(size_t idx, bool keep = false) {
       assert(idx < _objList.size());
       // TODO
       delete _objList[idx];
-      _objList[idx] = 0;
+      if (!keep) _objList[idx] = 0;
+      _objLive.remove(idx);
+      drainLog();
    }
-   // Delete the array with position idx in _arrList[]
-   void deleteArr(size_t idx) {
+   // Delete the array with position idx in _arrList[]; 'keep' as above
+   void deleteArr(size_t idx, bool keep = false) {
       assert(idx < _arrList.size());
       // TODO
       delete[] _arrList[idx];
-      _arrList[idx] = 0;
+      if (!keep) _arrList[idx] = 0;
+      _arrLive.remove(idx);
+      drainLog();
+   }
+
+   // Delete the objects with positions [b, e) in _objList[] in one batch
+   void deleteObjs(size_t b, size_t e) {
+      assert(b <= e && e <= _objList.size());
+      #ifdef MEM_MGR_H
+      vector<MemTestObj*> ps;
+      for (size_t i = b; i < e; ++i) {
+         if (_objList[i] == 0) continue;
+         _objList[i]->~MemTestObj();
+         ps.push_back(_objList[i]);
+         _objList[i] = 0;
+         _objLive.remove(i);
+      }
+      if (!ps.empty()) MemTestObj::memFreeBatch(ps.size(), &(ps[0]));
+      drainLog();
+      #else
+      for (size_t i = b; i < e; ++i) deleteObj(i);
+      #endif // MEM_MGR_H
+   }
+   // Delete the arrays with positions [b, e) in _arrList[] in one batch
+   void deleteArrs(size_t b, size_t e) {
+      assert(b <= e && e <= _arrList.size());
+      #ifdef MEM_MGR_H
+      vector<MemTestObj*> ps;
+      for (size_t i = b; i < e; ++i) {
+         MemTestObj* a = _arrList[i];
+         if (a == 0) continue;
+         // The array size is kept by the system in front of the array,
+         // where MemMgr::freeArr() gets it too
+         size_t* p = (size_t*)a - 1;
+         for (size_t j = *p; j > 0; --j) a[j - 1].~MemTestObj();
+         ps.push_back((MemTestObj*)p);
+         _arrList[i] = 0;
+         _arrLive.remove(i);
+      }
+      if (!ps.empty()) MemTestObj::memFreeArrBatch(ps.size(), &(ps[0]));
+      drainLog();
+      #else
+      for (size_t i = b; i < e; ++i) deleteArr(i);
+      #endif // MEM_MGR_H
+   }
+
+   // Multi-threaded stress (see MTNew and MTDelete -Threads).
+   // k workers new (delete) their own slices of the entries at once.
+   // The memory manager is thread-safe in MEM_THREAD_CACHE mode only;
+   // in the other modes the workers take turns by _mtLock at each call.
+   // Return the wall time in ns from when all the workers are up to when
+   // the last is done. The entries whose allocation failed are left 0.
+   double newObjsMT(size_t n, size_t k) {
+      return newMT(_objList, _objLive, n, 0, k); }
+   double newArrsMT(size_t n, size_t s, size_t k) {
+      return newMT(_arrList, _arrLive, n, s, k); }
+   // 'idx' are distinct positions in _objList[] (_arrList[]). Worker w
+   // deletes slice w + 1 (mod k) of them, so that, for the objects
+   // newed by as many workers, each deletes what another one newed.
+   double deleteObjsMT(const vector<size_t>& idx, size_t k) {
+      return deleteMT(_objList, _objLive, idx, false, k); }
+   double deleteArrsMT(const vector<size_t>& idx, size_t k) {
+      return deleteMT(_arrList, _arrLive, idx, true, k); }
+   // The positions of the live objects (arrays) in [b, e)
+   void getLive(bool arr, size_t b, size_t e, vector<size_t>& idx) const {
+      const vector<MemTestObj*>& l = arr? _arrList: _objList;
+      assert(b <= e && e <= l.size());
+      for (size_t i = b; i < e; ++i) if (l[i] != 0) idx.push_back(i);
+   }
+   bool isThreadSafe() const { return !needLock(); }
+
+   // Delete all the objects and arrays
+   void deleteAll() {
+      deleteObjs(0, _objList.size());
+      deleteArrs(0, _arrList.size());
    }
 
    void print() const {
@@ -109,8 +429,89 @@ public:
    }
 
 private:
+   // In MEM_DEBUG builds, print the events of each call when it returns,
+   // in place of the memory manager printing them as they happen
+   void drainLog() const {
+      #if defined(MEM_MGR_H) && defined(MEM_DEBUG)
+      memLog().drain(cout);
+      #endif // MEM_MGR_H && MEM_DEBUG
+   }
+
+   bool needLock() const {
+      #ifdef MEM_MGR_H
+      return MemTestObj::memGetThreadMode() != MEM_THREAD_CACHE;
+      #else
+      return false;
+      #endif // MEM_MGR_H
+   }
+   // Run f(w) on k threads for w in [0, k); see newObjsMT()
+   template <class F>
+   double runWorkers(size_t k, F f) {
+      atomic<size_t> ready(0);
+      atomic<bool> go(false);
+      vector<thread> ts;
+      for (size_t w = 0; w < k; ++w)
+         ts.push_back(thread([&, w]() {
+            ++ready;
+            while (!go.load(memory_order_acquire)) this_thread::yield();
+            f(w);
+         }));
+      while (ready.load() != k) this_thread::yield();
+      chrono::steady_clock::time_point t = chrono::steady_clock::now();
+      go.store(true, memory_order_release);
+      for (size_t w = 0; w < k; ++w) ts[w].join();
+      double ns = chrono::duration<double, nano>(
+                     chrono::steady_clock::now() - t).count();
+      drainLog();
+      return ns;
+   }
+   // 'n' objects, or arrays of size 's' if s > 0, at the end of 'l'
+   double newMT(vector<MemTestObj*>& l, MemTestLive& live, size_t n,
+                size_t s, size_t k) {
+      size_t b = l.size();
+      l.resize(b + n, 0);
+      bool lock = needLock();
+      double ns = runWorkers(k, [&](size_t w) {
+         size_t i = b + w * n / k, e = b + (w + 1) * n / k;
+         try {
+            for (; i < e; ++i) {
+               unique_lock<mutex> g(_mtLock, defer_lock);
+               if (lock) g.lock();
+               l[i] = s? new MemTestObj[s]: new MemTestObj;
+            }
+         }
+         catch (bad_alloc&) {}
+      });
+      for (size_t i = b; i < l.size(); ++i) if (l[i] != 0) live.add(i);
+      return ns;
+   }
+   double deleteMT(vector<MemTestObj*>& l, MemTestLive& live,
+                   const vector<size_t>& idx, bool arr, size_t k) {
+      size_t n = idx.size();
+      bool lock = needLock();
+      double ns = runWorkers(k, [&](size_t w) {
+         size_t v = (w + 1) % k;
+         for (size_t j = v * n / k, e = (v + 1) * n / k; j < e; ++j) {
+            MemTestObj* p = l[idx[j]];
+            {
+               unique_lock<mutex> g(_mtLock, defer_lock);
+               if (lock) g.lock();
+               if (arr) delete[] p;
+               else delete p;
+            }
+            l[idx[j]] = 0;
+         }
+      });
+      for (size_t j = 0; j < n; ++j) live.remove(idx[j]);
+      return ns;
+   }
+
    vector<MemTestObj*>   _objList;
    vector<MemTestObj*>   _arrList;
+   MemTestLive           _objLive;
+   MemTestLive           _arrLive;
+   vector<pair<size_t, size_t> >  _marks;  // list sizes at each mark
+   mutex                 _mtLock;  // see newObjsMT()
 };
 
 #endif // MEM_TEST_H
@@ -0,0 +1,137 @@
+/****************************************************************************
+  FileName     [ memTrace.h ]
+  PackageName  [ mem ]
+  Synopsis     [ Define the binary allocation trace of MemMgr ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+
+#ifndef MEM_TRACE_H
+#define MEM_TRACE_H
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+
+using namespace std;
+
+//--------------------------------------------------------------------------
+// Trace file format
+//--------------------------------------------------------------------------
+// A MemTraceHdr, then one MemTraceRec per operation up to the end of the
+// file, in the byte order of the machine that wrote it.
+// MEM_TRACE_BUF is the #records buffered before a write.
+#define MEM_TRACE_MAGIC   "MEMTRACE"
+#define MEM_TRACE_VERSION 1
+#define MEM_TRACE_BUF     4096
+
+enum MemTraceOp
+{
+   MEM_TRACE_ALLOC     = 0,  // alloc(); _size: the #Bytes requested
+   MEM_TRACE_ALLOC_ARR = 1,  // allocArr(); _size: the #Bytes requested
+   MEM_TRACE_FREE      = 2,  // free(); _size: sizeof(T)
+   MEM_TRACE_FREE_ARR  = 3,  // freeArr(); _size: as it was allocated
+   MEM_TRACE_RESET     = 4,  // reset(); _size: the new block size
+
+   // dummy
+   MEM_TRACE_TOT
+};
+
+struct MemTraceHdr
+{
+   char      _magic[8];
+   uint32_t  _version;
+   uint32_t  _objSize;    // sizeof(T)
+   uint32_t  _objAlign;   // see MemMgr::setAlign()
+   uint32_t  _recSize;    // sizeof(MemTraceRec)
+   uint64_t  _blockSize;  // when the trace started
+};
+
+struct MemTraceRec
+{
+   uint64_t  _time;       // ns since the trace started
+   uint64_t  _addr;       // as returned by alloc()/allocArr()
+   uint32_t  _size;
+   uint8_t   _op;         // MemTraceOp
+   uint8_t   _pad[3];
+};
+
+//--------------------------------------------------------------------------
+// Trace writer
+//--------------------------------------------------------------------------
+// Buffer the records of a MemMgr and write them MEM_TRACE_BUF at a time.
+// put() locks only if setLocked(true), for MEM_THREAD_CACHE mode.
+//
+class MemTracer
+{
+public:
+   MemTracer() : _file(0), _locked(false), _numRec(0), _numWritten(0) {}
+   ~MemTracer() { close(); }
+
+   // Start a new trace file; false if it cannot be written
+   bool open(const string& name, size_t objSize, size_t objAlign,
+             size_t blockSize) {
+      close();
+      if ((_file = fopen(name.c_str(), "wb")) == 0) return false;
+      MemTraceHdr h;
+      memset(&h, 0, sizeof(h));
+      memcpy(h._magic, MEM_TRACE_MAGIC, sizeof(h._magic));
+      h._version = MEM_TRACE_VERSION;
+      h._objSize = uint32_t(objSize);
+      h._objAlign = uint32_t(objAlign);
+      h._recSize = sizeof(MemTraceRec);
+      h._blockSize = blockSize;
+      if (fwrite(&h, sizeof(h), 1, _file) != 1) { close(); return false; }
+      _name = name;
+      _buf.resize(MEM_TRACE_BUF);
+      _numRec = _numWritten = 0;
+      _start = chrono::steady_clock::now();
+      return true;
+   }
+   // Flush and close the file; return the #records written
+   size_t close() {
+      if (_file == 0) return 0;
+      flush();
+      fclose(_file);
+      _file = 0;
+      return _numWritten;
+   }
+   bool isOpen() const { return _file != 0; }
+   const string& getName() const { return _name; }
+   size_t getNumRecs() const { return _numWritten + _numRec; }
+   void setLocked(bool l) { _locked = l; }
+
+   void put(MemTraceOp op, const void* p, size_t t) {
+      unique_lock<mutex> lock(_mutex, defer_lock);
+      if (_locked) lock.lock();
+      MemTraceRec& r = _buf[_numRec];
+      r._time = chrono::duration_cast<chrono::nanoseconds>(
+                   chrono::steady_clock::now() - _start).count();
+      r._addr = uint64_t(size_t(p));
+      r._size = uint32_t(t);
+      r._op = uint8_t(op);
+      r._pad[0] = r._pad[1] = r._pad[2] = 0;
+      if (++_numRec == MEM_TRACE_BUF) flush();
+   }
+
+private:
+   void flush() {
+      _numWritten += fwrite(&(_buf[0]), sizeof(MemTraceRec), _numRec, _file);
+      _numRec = 0;
+   }
+
+   FILE*                               _file;
+   string                              _name;
+   bool                                _locked;
+   mutex                               _mutex;
+   vector<MemTraceRec>                 _buf;
+   size_t                              _numRec;      // in _buf
+   size_t                              _numWritten;
+   chrono::steady_clock::time_point    _start;
+};
+
+#endif // MEM_TRACE_H
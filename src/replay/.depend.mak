@@ -0,0 +1,3 @@
+memReplay.o: memReplay.cpp replay.h ../../include/memTrace.h
+replayMgr.o: replayMgr.cpp replay.h ../../include/memTrace.h \
+ ../../include/memMgr.h ../../include/memTrace.h
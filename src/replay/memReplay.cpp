@@ -0,0 +1,137 @@
+/****************************************************************************
+  FileName     [ memReplay.cpp ]
+  PackageName  [ replay ]
+  Synopsis     [ main() of memReplay, and the trace reader ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include "replay.h"
+
+using namespace std;
+
+bool
+readTrace(const char* name, ReplayTrace& tr)
+{
+   FILE* f = fopen(name, "rb");
+   if (f == 0) {
+      cerr << "Error: cannot open trace file \"" << name << "\"!!" << endl;
+      return false;
+   }
+   MemTraceHdr& h = tr._hdr;
+   if (fread(&h, sizeof(h), 1, f) != 1 ||
+       memcmp(h._magic, MEM_TRACE_MAGIC, sizeof(h._magic)) != 0 ||
+       h._version != MEM_TRACE_VERSION || h._recSize != sizeof(MemTraceRec)) {
+      cerr << "Error: \"" << name << "\" is not a trace of version "
+           << MEM_TRACE_VERSION << "!!" << endl;
+      fclose(f);
+      return false;
+   }
+   tr._ops.clear();
+   tr._numSlots = tr._maxLive = tr._numDropped = 0;
+   // The live allocations: address -> (slot, size)
+   unordered_map<uint64_t, pair<size_t, uint32_t> > live;
+   size_t liveBytes = 0;
+   vector<MemTraceRec> buf(MEM_TRACE_BUF);
+   size_t k;
+   while ((k = fread(&(buf[0]), sizeof(MemTraceRec), buf.size(), f)) > 0) {
+      for (size_t i = 0; i < k; ++i) {
+         const MemTraceRec& r = buf[i];
+         ReplayOp o;
+         o._op = r._op;
+         o._size = r._size;
+         o._slot = 0;
+         if (r._op == MEM_TRACE_ALLOC || r._op == MEM_TRACE_ALLOC_ARR) {
+            o._slot = tr._numSlots++;
+            live[r._addr] = make_pair(o._slot, r._size);
+            if ((liveBytes += r._size) > tr._maxLive)
+               tr._maxLive = liveBytes;
+         }
+         else if (r._op == MEM_TRACE_FREE || r._op == MEM_TRACE_FREE_ARR) {
+            unordered_map<uint64_t, pair<size_t, uint32_t> >::iterator
+               it = live.find(r._addr);
+            if (it == live.end()) { ++tr._numDropped; continue; }
+            o._slot = it->second.first;
+            liveBytes -= it->second.second;
+            live.erase(it);
+         }
+         else if (r._op == MEM_TRACE_RESET) {
+            live.clear();
+            liveBytes = 0;
+         }
+         else {
+            cerr << "Error: bad record (op " << int(r._op) << ") in \""
+                 << name << "\"!!" << endl;
+            fclose(f);
+            return false;
+         }
+         tr._ops.push_back(o);
+      }
+   }
+   fclose(f);
+   return true;
+}
+
+static void
+report(const char* mode, const ReplayTrace& tr, const ReplayResult& timed,
+       const ReplayResult& sampled)
+{
+   size_t n = tr._ops.size();
+   cout << "  " << setw(10) << left << mode << right << fixed
+        << setprecision(2) << setw(10) << timed._ns / 1e6
+        << setw(9) << (n? timed._ns / n: 0.0);
+   if (sampled._maxBytes == 0)
+      cout << setw(11) << "-" << setw(9) << "-" << endl;
+   else
+      cout << setw(11) << sampled._maxBytes / 1024
+           << setw(8) << 100.0 * (1 - double(tr._maxLive) / sampled._maxBytes)
+           << "%" << endl;
+   cout.unsetf(ios::floatfield);
+}
+
+static void
+usage()
+{
+   cout << "Usage: memReplay <(string traceFile)> [-Block (size_t blockSize)]"
+        << endl;
+}
+
+int
+main(int argc, char** argv)
+{
+   if (argc != 2 && argc != 4) { usage(); return 1; }
+   size_t b = 0;
+   if (argc == 4) {
+      char* end = 0;
+      if (strcmp(argv[2], "-Block") != 0 ||
+          (b = strtoul(argv[3], &end, 10)) == 0 || *end != '\0' ||
+          b % sizeof(size_t) != 0) {
+         usage();
+         return 1;
+      }
+   }
+   ReplayTrace tr;
+   if (!readTrace(argv[1], tr)) return 1;
+
+   cout << "== replay: " << argv[1] << " (" << tr._ops.size()
+        << " operations, " << tr._numDropped << " untraced frees dropped)"
+        << endl
+        << "* Objects of " << tr._hdr._objSize << " Bytes, blocks of "
+        << (b? b: tr._hdr._blockSize) << " Bytes" << endl
+        << "* Peak requested Bytes: " << tr._maxLive << endl
+        << "  allocator   time(ms)    ns/op   peak(KB)    frag" << endl;
+   ReplayResult timed, sampled;
+   if (replayMemMgr(tr, b, timed, sampled))
+      report("MemMgr", tr, timed, sampled);
+   else
+      cout << "  MemMgr      (not built for " << tr._hdr._objSize
+           << "-Byte objects)" << endl;
+   replayMalloc(tr, timed, sampled);
+   report("malloc", tr, timed, sampled);
+   return 0;
+}
@@ -0,0 +1,100 @@
+/****************************************************************************
+  FileName     [ replay.h ]
+  PackageName  [ replay ]
+  Synopsis     [ Define the trace replay of memReplay ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <stdint.h>
+#include "memTrace.h"
+
+using namespace std;
+
+// An operation of a trace (see memTrace.h), with the addresses turned
+// into slots: each allocation has a slot of its own, which its free
+// refers to
+struct ReplayOp
+{
+   uint32_t  _op;         // MemTraceOp
+   uint32_t  _size;
+   size_t    _slot;       // not for MEM_TRACE_RESET
+};
+
+struct ReplayTrace
+{
+   MemTraceHdr        _hdr;
+   vector<ReplayOp>   _ops;
+   size_t             _numSlots;
+   size_t             _maxLive;     // peak #Bytes requested and not freed
+   size_t             _numDropped;  // frees of what was not traced
+};
+
+// What a replay measured
+struct ReplayResult
+{
+   double  _ns;           // the whole replay
+   size_t  _maxBytes;     // peak footprint; 0 if not sampled
+};
+
+// Replay 'tr' on the allocator 'a', which has
+//    void start() (called right before the first operation),
+//    void* alloc(size_t t), void* allocArr(size_t t),
+//    void free(void* p), void freeArr(void* p),
+//    void reset(size_t b, vector<void*>& slots) (to drop all the slots),
+//    size_t footprint()
+// The footprint is sampled after every allocation if 'sample', which
+// makes the time meaningless.
+template <class A>
+void
+replayRun(const ReplayTrace& tr, A& a, bool sample, ReplayResult& r)
+{
+   vector<void*> slots(tr._numSlots, 0);
+   size_t maxBytes = 0;
+   a.start();
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   for (size_t i = 0, n = tr._ops.size(); i < n; ++i) {
+      const ReplayOp& o = tr._ops[i];
+      switch (o._op) {
+         case MEM_TRACE_ALLOC:
+            slots[o._slot] = a.alloc(o._size); break;
+         case MEM_TRACE_ALLOC_ARR:
+            slots[o._slot] = a.allocArr(o._size); break;
+         case MEM_TRACE_FREE:
+            a.free(slots[o._slot]); slots[o._slot] = 0; break;
+         case MEM_TRACE_FREE_ARR:
+            a.freeArr(slots[o._slot]); slots[o._slot] = 0; break;
+         default:
+            if (sample && a.footprint() > maxBytes) maxBytes = a.footprint();
+            a.reset(o._size, slots);
+            continue;
+      }
+      if (sample && o._op <= MEM_TRACE_ALLOC_ARR && a.footprint() > maxBytes)
+         maxBytes = a.footprint();
+   }
+   r._ns = chrono::duration<double, nano>(
+              chrono::steady_clock::now() - start).count();
+   r._maxBytes = maxBytes;
+   // Drop what is still live
+   a.reset(0, slots);
+}
+
+// Read the trace file 'name' into 'tr'; false (with the reason on cerr)
+// if it is not a trace
+extern bool readTrace(const char* name, ReplayTrace& tr);
+// Replay 'tr' on MemMgr, with blocks of 'b' Bytes (0 for those of the
+// trace), and on malloc(); 'timed' and 'sampled' as by replayRun().
+// replayMemMgr() is false if the object size of the trace is not one of
+// those it is built for.
+extern bool replayMemMgr(const ReplayTrace& tr, size_t b,
+                         ReplayResult& timed, ReplayResult& sampled);
+extern void replayMalloc(const ReplayTrace& tr,
+                         ReplayResult& timed, ReplayResult& sampled);
+
+#endif // REPLAY_H
@@ -0,0 +1,126 @@
+/****************************************************************************
+  FileName     [ replayMgr.cpp ]
+  PackageName  [ replay ]
+  Synopsis     [ Replay a trace on MemMgr and on malloc() ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <cstdlib>
+#include <malloc.h>
+#include "replay.h"
+#include "memMgr.h"
+
+using namespace std;
+
+// MemMgr on the objects of 'N' Bytes (with no alignment of their own)
+template <size_t N>
+class ReplayMgr
+{
+public:
+   typedef MemRaw<N, 1>  Obj;
+
+   ReplayMgr(const MemTraceHdr& h, size_t b)
+   : _mgr(b? b: size_t(h._blockSize)), _fixed(b != 0) {
+      _mgr.setAlign(h._objAlign);
+      _mgr.setLargeObj(true);
+   }
+
+   void start() {}
+   void* alloc(size_t t) { return _mgr.alloc(t); }
+   // With the array size in front, as new[] would do
+   void* allocArr(size_t t) {
+      size_t* p = (size_t*)(_mgr.allocArr(t));
+      *p = (t - SIZE_T) / N;
+      return p;
+   }
+   void free(void* p) { _mgr.free((Obj*)p); }
+   void freeArr(void* p) { _mgr.freeArr((Obj*)p); }
+   void reset(size_t b, vector<void*>& slots) {
+      _mgr.reset(_fixed? 0: b);
+      fill(slots.begin(), slots.end(), (void*)0);
+   }
+   size_t footprint() const { return _mgr.getFootprint(); }
+
+private:
+   MemMgr<Obj>  _mgr;
+   bool         _fixed;   // the block size is not the trace's
+};
+
+// Dispatch the object size to ReplayMgr<N> for N in [N, Max] by Step.
+// Each size costs seconds to build, so only some are.
+template <size_t N, size_t Step, size_t Max, bool End = (N > Max)>
+struct ReplayAs
+{
+   static bool run(const ReplayTrace& tr, size_t b, ReplayResult& timed,
+                   ReplayResult& sampled) {
+      if (tr._hdr._objSize != N)
+         return ReplayAs<N + Step, Step, Max>::run(tr, b, timed, sampled);
+      {
+         ReplayMgr<N> m(tr._hdr, b);
+         replayRun(tr, m, false, timed);
+      }
+      ReplayMgr<N> m(tr._hdr, b);
+      replayRun(tr, m, true, sampled);
+      return true;
+   }
+};
+
+template <size_t N, size_t Step, size_t Max>
+struct ReplayAs<N, Step, Max, true>
+{
+   static bool run(const ReplayTrace&, size_t, ReplayResult&,
+                   ReplayResult&) { return false; }
+};
+
+// The object sizes of 4 to 64 Bytes by 4, and of 96 to 256 Bytes by 32
+bool
+replayMemMgr(const ReplayTrace& tr, size_t b, ReplayResult& timed,
+             ReplayResult& sampled)
+{
+   return ReplayAs<4, 4, 64>::run(tr, b, timed, sampled) ||
+          ReplayAs<96, 32, 256>::run(tr, b, timed, sampled);
+}
+
+// malloc(); its footprint is the #Bytes of the chunks in use, headers
+// included, since start(). The free chunks are not counted, as those
+// freed before the replay are mixed with them.
+class ReplayMalloc
+{
+public:
+   ReplayMalloc() : _base(0) {}
+
+   void start() { _base = 0; _base = footprint(); }
+
+   void* alloc(size_t t) { return malloc(t); }
+   void* allocArr(size_t t) { return malloc(t); }
+   void free(void* p) { ::free(p); }
+   void freeArr(void* p) { ::free(p); }
+   void reset(size_t, vector<void*>& slots) {
+      for (size_t i = 0; i < slots.size(); ++i)
+         if (slots[i] != 0) { ::free(slots[i]); slots[i] = 0; }
+   }
+   size_t footprint() const {
+      #if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+      struct mallinfo2 mi = mallinfo2();
+      size_t b = mi.uordblks + mi.hblkhd;
+      return (b > _base)? b - _base: 0;
+      #else
+      return 0;
+      #endif
+   }
+
+private:
+   size_t  _base;
+};
+
+void
+replayMalloc(const ReplayTrace& tr, ReplayResult& timed,
+             ReplayResult& sampled)
+{
+   {
+      ReplayMalloc m;
+      replayRun(tr, m, false, timed);
+   }
+   ReplayMalloc m;
+   replayRun(tr, m, true, sampled);
+}
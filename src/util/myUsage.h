@@ -10,6 +10,9 @@
 #define MY_USAGE_H
 
 #include <unistd.h>
+#include <time.h>
+#include <cstdio>
+#include <cstddef>
 #include <iostream>
 #include <iomanip>
 #include <sys/times.h>
@@ -22,6 +25,9 @@ using namespace std;
 #define MYCLK_TCK sysconf(_SC_CLK_TCK)
 
 
+// report() is inlined in the prebuilt libcmd (see USAGE), so the members
+// it uses must stay first and as they are; new ones go after them.
+//
 class MyUsage
 {
 public:
@@ -31,6 +37,11 @@ public:
       _initMem = checkMem();
       _currentTick =  checkTick();
       _periodUsedTime = _totalUsedTime = 0.0;
+      _initWall = _lastWall = checkClock(CLOCK_MONOTONIC);
+      _initCpu = _lastCpu = checkClock(CLOCK_PROCESS_CPUTIME_ID);
+      _initThread = _lastThread = checkClock(CLOCK_THREAD_CPUTIME_ID);
+      checkFaults(_initMinFlt, _initMajFlt);
+      _initRss = checkRss();
    }
 
    void report(bool repTime, bool repMem) {
@@ -48,6 +59,44 @@ public:
       }
    }
 
+   // Wall, process CPU and thread CPU seconds of the period (since the
+   // last call) and in total (since reset()), in ns resolution
+   void reportClocks() {
+      double wall = checkClock(CLOCK_MONOTONIC);
+      double cpu = checkClock(CLOCK_PROCESS_CPUTIME_ID);
+      double thread = checkClock(CLOCK_THREAD_CPUTIME_ID);
+      cout << "               period(s)      total(s)" << endl << fixed
+           << setprecision(6)
+           << "Wall clock :" << setw(14) << wall - _lastWall
+           << setw(14) << wall - _initWall << endl
+           << "Process CPU:" << setw(14) << cpu - _lastCpu
+           << setw(14) << cpu - _initCpu << endl
+           << "Thread CPU :" << setw(14) << thread - _lastThread
+           << setw(14) << thread - _initThread << endl;
+      cout.unsetf(ios::floatfield);
+      _lastWall = wall; _lastCpu = cpu; _lastThread = thread;
+   }
+   // The current and peak RSS and the page faults since reset(), with the
+   // #Bytes 'heldBytes' that the memory managers hold from the system
+   // against the RSS growth. What they hold and never touched is not
+   // resident; the rest of the growth is others' (e.g. the STL, stdio).
+   void reportRss(size_t heldBytes) {
+      long rss = long(checkRss() >> 10), held = long(heldBytes >> 10);
+      long growth = rss - long(_initRss >> 10);
+      long minFlt, majFlt;
+      checkFaults(minFlt, majFlt);
+      cout << "Current RSS      : " << rss << " KB" << endl
+           << "Peak RSS         : " << long(checkMem() * 1024) << " KB"
+           << endl
+           << "RSS growth       : " << growth << " KB" << endl
+           << "  held by MemMgr : " << held << " KB" << endl
+           << "  other          : " << growth - held << " KB" << endl
+           << "Page faults      : " << minFlt - _initMinFlt << " minor, "
+           << majFlt - _initMajFlt << " major" << endl;
+   }
+   // The resident #Bytes now; 0 if /proc/self/statm cannot be read
+   size_t getCurrentRss() const { return checkRss(); }
+
 private:
    // for Memory usage (in MB)
    double     _initMem;
@@ -75,6 +124,28 @@ private:
       times(&tBuffer);
       return tBuffer.tms_utime;
    }
+   // Seconds on the clock 'c'; 0 if it is not there
+   double checkClock(clockid_t c) const {
+      struct timespec t;
+      if (clock_gettime(c, &t) != 0) return 0;
+      return t.tv_sec + t.tv_nsec / 1e9;
+   }
+   size_t checkRss() const {
+      FILE* f = fopen("/proc/self/statm", "r");
+      if (f == 0) return 0;
+      unsigned long size = 0, resident = 0;
+      if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+      fclose(f);
+      return size_t(resident) * size_t(sysconf(_SC_PAGESIZE));
+   }
+   void checkFaults(long& minFlt, long& majFlt) const {
+      struct rusage usage;
+      minFlt = majFlt = 0;
+      if (0 == getrusage(RUSAGE_SELF, &usage)) {
+         minFlt = usage.ru_minflt;
+         majFlt = usage.ru_majflt;
+      }
+   }
    void setMemUsage() { _currentMem = checkMem() - _initMem; }
    void setTimeUsage() {
       double thisTick = checkTick();
@@ -83,6 +154,13 @@ private:
       _currentTick = thisTick;
    }
       
+   // High-resolution clocks (in seconds), page faults and current RSS,
+   // at reset() and at the last reportClocks()
+   double     _initWall, _lastWall;
+   double     _initCpu, _lastCpu;
+   double     _initThread, _lastThread;
+   long       _initMinFlt, _initMajFlt;
+   size_t     _initRss;
 };
 
 #endif // MY_USAGE_H